@@ -2,6 +2,14 @@
 
 #include <cstdint>
 
+// Stable reference to an element of a DECLARE_ARRAY.
+// index selects a sparse slot, generation is odd while the slot is live.
+// Handle{} never refers to an element.
+struct Handle {
+  uint32_t index;
+  uint32_t generation;
+};
+
 // For the given type defines:
 //    kMax<type> - The upper bound count for the given type.
 //    k<type> - The storage for the type.
@@ -9,28 +17,76 @@
 // Methods:
 //    Use<type>() - Function to request use of a instance of type.
 //    Release<type>() - Function to return an instance of type.
-#define DECLARE_ARRAY(type, max_count)          \
-  constexpr uint64_t kMax##type = max_count;    \
-                                                \
-  static type k##type[max_count];               \
-                                                \
-  static uint64_t kUsed##type;                  \
-                                                \
-  type* Use##type()                             \
-  {                                             \
-    if (kUsed##type >= kMax##type) return NULL; \
-    type* t = &k##type[kUsed##type];            \
-    kUsed##type += 1;                           \
-    return t;                                   \
-  }                                             \
-                                                \
-  void Release##type(uint64_t id)               \
-  {                                             \
-    uint64_t used = kUsed##type;                \
-    if (!used) return;                          \
-    if (id >= used) return;                     \
-    used -= 1;                                  \
-    kUsed##type = used;                         \
-    if (id == used) return;                     \
-    k##type[id] = k##type[used];                \
+//    Handle<type>(id) - Stable handle of the element at k<type>[id].
+//    Find<type>(handle) - The element, or NULL once it was released.
+//
+// Elements stay densely packed in k<type>, release moves the last element
+// into the hole. Handles survive the move through a sparse slot table:
+//    kSparse<type>[slot] - index into k<type> of a live slot.
+//    kDense<type>[id] - slot of k<type>[id] for id < kUsed, and the free
+//        slots for kUsed <= id < kHighSlot.
+//    kGeneration<type>[slot] - bumped on every use and release.
+#define DECLARE_ARRAY(type, max_count)                          \
+  constexpr uint64_t kMax##type = max_count;                    \
+  static_assert(max_count <= UINT32_MAX, "Handle index bits"); \
+                                                                \
+  static type k##type[max_count];                               \
+                                                                \
+  static uint64_t kUsed##type;                                  \
+                                                                \
+  static uint32_t kSparse##type[max_count];                     \
+  static uint32_t kDense##type[max_count];                      \
+  static uint32_t kGeneration##type[max_count];                 \
+  static uint32_t kHighSlot##type;                              \
+                                                                \
+  type* Use##type()                                             \
+  {                                                             \
+    if (kUsed##type >= kMax##type) return NULL;                 \
+    uint64_t id = kUsed##type;                                  \
+    uint32_t slot = kDense##type[id];                           \
+    if (id == kHighSlot##type) slot = kHighSlot##type++;        \
+    kDense##type[id] = slot;                                    \
+    kSparse##type[slot] = id;                                   \
+    kGeneration##type[slot] += 1;                               \
+    type* t = &k##type[id];                                     \
+    kUsed##type += 1;                                           \
+    return t;                                                   \
+  }                                                             \
+                                                                \
+  void Release##type(uint64_t id)                               \
+  {                                                             \
+    uint64_t used = kUsed##type;                                \
+    if (!used) return;                                          \
+    if (id >= used) return;                                     \
+    used -= 1;                                                  \
+    kUsed##type = used;                                         \
+    uint32_t slot = kDense##type[id];                           \
+    kGeneration##type[slot] += 1;                               \
+    kDense##type[id] = kDense##type[used];                      \
+    kDense##type[used] = slot;                                  \
+    if (id == used) return;                                     \
+    k##type[id] = k##type[used];                                \
+    kSparse##type[kDense##type[id]] = id;                       \
+  }                                                             \
+                                                                \
+  Handle Handle##type(uint64_t id)                              \
+  {                                                             \
+    if (id >= kUsed##type) return Handle{};                     \
+    uint32_t slot = kDense##type[id];                           \
+    return Handle{slot, kGeneration##type[slot]};               \
+  }                                                             \
+                                                                \
+  type* Find##type(Handle handle)                               \
+  {                                                             \
+    if (handle.index >= kHighSlot##type) return NULL;           \
+    if (kGeneration##type[handle.index] != handle.generation)   \
+      return NULL;                                              \
+    if (!(handle.generation & 1)) return NULL;                  \
+    return &k##type[kSparse##type[handle.index]];               \
+  }                                                             \
+                                                                \
+  void Release##type(Handle handle)                             \
+  {                                                             \
+    if (!Find##type(handle)) return;                            \
+    Release##type(kSparse##type[handle.index]);                 \
   }
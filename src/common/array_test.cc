@@ -1,3 +1,4 @@
+#include <cassert>
 #include <cstdio>
 
 #include "array.cc"
@@ -8,6 +9,8 @@ struct Entity {
 
 DECLARE_ARRAY(Entity, 8);
 
+#define ASSERT_TRUE(x) assert(x)
+
 Entity* ents[kMaxEntity + 1];
 
 void
@@ -28,6 +31,56 @@ print_ids()
   }
 }
 
+void
+handles()
+{
+  while (kUsedEntity) ReleaseEntity(0);
+
+  Handle h[4];
+  for (int i = 0; i < 4; ++i) {
+    UseEntity()->id = 100 + i;
+    h[i] = HandleEntity(i);
+    ASSERT_TRUE(FindEntity(h[i])->id == (uint64_t)(100 + i));
+  }
+
+  // Swap-remove moves the last element, its handle follows it
+  ReleaseEntity(h[1]);
+  ASSERT_TRUE(kUsedEntity == 3);
+  ASSERT_TRUE(FindEntity(h[1]) == NULL);
+  for (int i = 0; i < 4; ++i) {
+    if (i == 1) continue;
+    ASSERT_TRUE(FindEntity(h[i])->id == (uint64_t)(100 + i));
+  }
+  ASSERT_TRUE(FindEntity(h[3]) == &kEntity[1]);
+
+  // Reused slot gets a new generation, the stale handle stays dead
+  UseEntity()->id = 200;
+  Handle reuse = HandleEntity(kUsedEntity - 1);
+  ASSERT_TRUE(reuse.index == h[1].index);
+  ASSERT_TRUE(reuse.generation != h[1].generation);
+  ASSERT_TRUE(FindEntity(h[1]) == NULL);
+  ASSERT_TRUE(FindEntity(reuse)->id == 200);
+
+  // Releasing a stale handle is a no-op
+  ReleaseEntity(h[1]);
+  ASSERT_TRUE(kUsedEntity == 4);
+  ASSERT_TRUE(FindEntity(Handle{}) == NULL);
+  ASSERT_TRUE(HandleEntity(kUsedEntity).generation == 0);
+
+  // Fill and drain by handle
+  Handle all[kMaxEntity];
+  while (UseEntity())
+    ;
+  for (uint64_t i = 0; i < kMaxEntity; ++i) all[i] = HandleEntity(i);
+  for (uint64_t i = 0; i < kMaxEntity; ++i) {
+    ASSERT_TRUE(FindEntity(all[i]));
+    ReleaseEntity(all[i]);
+    ASSERT_TRUE(!FindEntity(all[i]));
+  }
+  ASSERT_TRUE(kUsedEntity == 0);
+  puts("handles ok");
+}
+
 int
 main()
 {
@@ -59,6 +112,8 @@ main()
   ReleaseEntity(0);
   print_ids();
 
+  handles();
+
   return 0;
 }
 
@@ -1,4 +1,7 @@
 #pragma once
 
 #include "array.cc"
+#include "ecs.cc"
+#include "hash.cc"
+#include "heap.cc"
 #include "queue.cc"
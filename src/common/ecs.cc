@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+// Struct of arrays component storage, promoted from example/ecs.
+// Each component type has its own dense array, so a loop over one
+// component streams only that component's bytes.
+//
+// Columns are sparse sets: sparse[entity] indexes the dense arrays and is
+// only trusted when entity[sparse[entity]] points back, so no clearing is
+// needed. Removal moves the last element into the hole.
+namespace ecs
+{
+using Entity = uint32_t;
+
+template <typename T, uint32_t N>
+struct Column {
+  uint32_t count;
+  uint32_t sparse[N];
+  Entity entity[N];
+  T data[N];
+};
+
+// Entities are ids in [0, N)
+template <uint32_t N, typename... Ts>
+struct ComponentStorage {
+  static constexpr uint32_t kMaxEntity = N;
+
+  template <typename T>
+  Column<T, N>&
+  Col()
+  {
+    return std::get<Column<T, N>>(columns);
+  }
+
+  template <typename T>
+  bool
+  Has(Entity e)
+  {
+    Column<T, N>& c = Col<T>();
+    if (e >= N) return false;
+    uint32_t i = c.sparse[e];
+    return i < c.count && c.entity[i] == e;
+  }
+
+  template <typename T>
+  T*
+  Get(Entity e)
+  {
+    if (!Has<T>(e)) return nullptr;
+    Column<T, N>& c = Col<T>();
+    return &c.data[c.sparse[e]];
+  }
+
+  // Returns the component, replacing any the entity already had.
+  // nullptr when e is out of range.
+  template <typename T, typename... Args>
+  T*
+  Assign(Entity e, Args&&... args)
+  {
+    if (e >= N) return nullptr;
+    Column<T, N>& c = Col<T>();
+    uint32_t i = c.sparse[e];
+    if (!(i < c.count && c.entity[i] == e)) {
+      i = c.count++;
+      c.sparse[e] = i;
+      c.entity[i] = e;
+    }
+    c.data[i] = T{std::forward<Args>(args)...};
+    return &c.data[i];
+  }
+
+  template <typename T>
+  void
+  Remove(Entity e)
+  {
+    if (!Has<T>(e)) return;
+    Column<T, N>& c = Col<T>();
+    uint32_t i = c.sparse[e];
+    uint32_t last = --c.count;
+    if (i == last) return;
+    c.data[i] = c.data[last];
+    c.entity[i] = c.entity[last];
+    c.sparse[c.entity[i]] = i;
+  }
+
+  template <typename T>
+  void
+  Clear()
+  {
+    Col<T>().count = 0;
+  }
+
+  // Removes every component of e
+  void
+  Delete(Entity e)
+  {
+    (Remove<Ts>(e), ...);
+  }
+
+  // Dense view of one component, valid until the next Assign/Remove
+  template <typename T>
+  uint32_t
+  Count()
+  {
+    return Col<T>().count;
+  }
+
+  template <typename T>
+  T*
+  Data()
+  {
+    return Col<T>().data;
+  }
+
+  // Calls f(entity, Q&...) for each entity that has every Q.
+  // Walks the smallest column and looks the others up by entity, a single
+  // component walks its dense array in order.
+  // f must not Assign or Remove the enumerated components.
+  template <typename... Q, typename F>
+  void
+  Enumerate(F&& f)
+  {
+    uint32_t smallest = UINT32_MAX;
+    ((smallest = Col<Q>().count < smallest ? Col<Q>().count : smallest), ...);
+    bool done = false;
+    ((done = done || (Col<Q>().count == smallest &&
+                      (EnumerateFrom<Q, Q...>(f), true))),
+     ...);
+  }
+
+  template <typename D, typename... Q, typename F>
+  void
+  EnumerateFrom(F& f)
+  {
+    Column<D, N>& d = Col<D>();
+    for (uint32_t i = 0; i < d.count; ++i) {
+      Entity e = d.entity[i];
+      if constexpr (sizeof...(Q) == 1) {
+        f(e, d.data[i]);
+      } else {
+        if (!(Has<Q>(e) && ...)) continue;
+        f(e, Col<Q>().data[Col<Q>().sparse[e]]...);
+      }
+    }
+  }
+
+  std::tuple<Column<Ts, N>...> columns;
+};
+
+}  // namespace ecs
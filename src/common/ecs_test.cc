@@ -0,0 +1,176 @@
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+
+#include "array.cc"
+#include "ecs.cc"
+#include "math/math.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+struct Position {
+  math::Vec3f v;
+};
+
+struct Velocity {
+  math::Vec3f v;
+};
+
+struct Tag {
+  int kind;
+};
+
+static ecs::ComponentStorage<64, Position, Velocity, Tag> kSmall;
+
+void
+AssignGetRemove()
+{
+  ASSERT_TRUE(!kSmall.Get<Position>(3));
+  kSmall.Assign<Position>(3, math::Vec3f(1.f, 2.f, 3.f));
+  kSmall.Assign<Position>(5, math::Vec3f(5.f, 0.f, 0.f));
+  kSmall.Assign<Position>(7, math::Vec3f(7.f, 0.f, 0.f));
+  ASSERT_TRUE(kSmall.Get<Position>(3)->v.y == 2.f);
+  ASSERT_TRUE(!kSmall.Get<Velocity>(3));
+  ASSERT_TRUE(!kSmall.Assign<Position>(64));
+
+  // Reassigning replaces in place
+  kSmall.Assign<Position>(3, math::Vec3f(9.f, 9.f, 9.f));
+  ASSERT_TRUE(kSmall.Count<Position>() == 3);
+  ASSERT_TRUE(kSmall.Get<Position>(3)->v.x == 9.f);
+
+  // Swap-remove keeps the moved entity reachable
+  kSmall.Remove<Position>(3);
+  ASSERT_TRUE(!kSmall.Has<Position>(3));
+  ASSERT_TRUE(kSmall.Get<Position>(7)->v.x == 7.f);
+  ASSERT_TRUE(kSmall.Get<Position>(5)->v.x == 5.f);
+  ASSERT_TRUE(kSmall.Count<Position>() == 2);
+
+  kSmall.Clear<Position>();
+  ASSERT_TRUE(!kSmall.Has<Position>(5));
+  ASSERT_TRUE(kSmall.Count<Position>() == 0);
+}
+
+void
+Join()
+{
+  for (ecs::Entity e = 0; e < 16; ++e) {
+    kSmall.Assign<Position>(e, math::Vec3f(e, 0.f, 0.f));
+    if (e % 2 == 0) kSmall.Assign<Velocity>(e, math::Vec3f(0.f, 1.f, 0.f));
+    if (e % 3 == 0) kSmall.Assign<Tag>(e, (int)e);
+  }
+
+  int count = 0;
+  kSmall.Enumerate<Position>([&](ecs::Entity, Position&) { count += 1; });
+  ASSERT_TRUE(count == 16);
+
+  count = 0;
+  kSmall.Enumerate<Position, Velocity>(
+      [&](ecs::Entity e, Position& p, Velocity& v) {
+        ASSERT_TRUE(e % 2 == 0);
+        p.v += v.v;
+        count += 1;
+      });
+  ASSERT_TRUE(count == 8);
+  ASSERT_TRUE(kSmall.Get<Position>(4)->v.y == 1.f);
+  ASSERT_TRUE(kSmall.Get<Position>(5)->v.y == 0.f);
+
+  // Order of the type list does not change the result
+  count = 0;
+  kSmall.Enumerate<Tag, Position, Velocity>(
+      [&](ecs::Entity e, Tag& t, Position&, Velocity&) {
+        ASSERT_TRUE(e % 6 == 0);
+        ASSERT_TRUE(t.kind == (int)e);
+        count += 1;
+      });
+  ASSERT_TRUE(count == 3);
+
+  kSmall.Delete(6);
+  ASSERT_TRUE(!kSmall.Has<Position>(6));
+  ASSERT_TRUE(!kSmall.Has<Velocity>(6));
+  ASSERT_TRUE(!kSmall.Has<Tag>(6));
+  count = 0;
+  kSmall.Enumerate<Velocity, Tag>(
+      [&](ecs::Entity, Velocity&, Tag&) { count += 1; });
+  ASSERT_TRUE(count == 2);
+}
+
+// Position update of the simulation, AoS DECLARE_ARRAY versus SoA columns
+constexpr uint32_t kBenchEntity = 1 << 16;
+constexpr int kBenchTicks = 200;
+
+struct BenchTransform {
+  math::Vec3f position;
+  math::Vec3f scale;
+  math::Quatf orientation;
+};
+
+// Same layout as simulation Unit
+struct BenchUnit {
+  BenchTransform transform;
+  uint32_t command_type;
+  math::Vec2f destination;
+  uint64_t think_flags;
+  int kind;
+};
+DECLARE_ARRAY(BenchUnit, kBenchEntity);
+
+struct Scale {
+  math::Vec3f v;
+};
+
+struct Orientation {
+  math::Quatf q;
+};
+
+static ecs::ComponentStorage<kBenchEntity, Position, Scale, Orientation>
+    kBench;
+
+void
+Benchmark()
+{
+  for (uint32_t i = 0; i < kBenchEntity; ++i) {
+    math::Vec3f pos(i % 800, i / 800, 0.f);
+    UseBenchUnit()->transform.position = pos;
+    kBench.Assign<Position>(i, pos);
+    kBench.Assign<Scale>(i, math::Vec3f(1.f, 1.f, 1.f));
+    kBench.Assign<Orientation>(i);
+  }
+
+  clock_t c = clock();
+  for (int t = 0; t < kBenchTicks; ++t) {
+    for (uint64_t i = 0; i < kUsedBenchUnit; ++i) {
+      math::Vec3f& p = kBenchUnit[i].transform.position;
+      p.x -= 1.f;
+      if (p.x < 0.f) p.x = 800.f;
+    }
+  }
+  double aos_ms = 1000.0 * (clock() - c) / CLOCKS_PER_SEC;
+
+  c = clock();
+  for (int t = 0; t < kBenchTicks; ++t) {
+    kBench.Enumerate<Position>([](ecs::Entity, Position& p) {
+      p.v.x -= 1.f;
+      if (p.v.x < 0.f) p.v.x = 800.f;
+    });
+  }
+  double soa_ms = 1000.0 * (clock() - c) / CLOCKS_PER_SEC;
+
+  for (uint32_t i = 0; i < kBenchEntity; ++i) {
+    ASSERT_TRUE(kBench.Get<Position>(i)->v.x ==
+                kBenchUnit[i].transform.position.x);
+  }
+
+  printf("%u entities x %d ticks: aos %.2f ms (%zu B) soa %.2f ms (%zu B)\n",
+         kBenchEntity, kBenchTicks, aos_ms, sizeof(BenchUnit), soa_ms,
+         sizeof(Position));
+}
+
+int
+main()
+{
+  AssignGetRemove();
+  Join();
+  Benchmark();
+  printf("ecs ok\n");
+  return 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// XXH64: four independent 64-bit lanes over 32 byte stripes.
+// The lanes have no dependency on each other, so the main loop pipelines
+// (and vectorizes where 64-bit multiply is available).
+// Hashes chain through seed: Hash64(b, n, Hash64(a, m, 0))
+
+constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t
+HashRotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t
+HashRead64(const uint8_t* p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t
+HashRead32(const uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t
+HashRound(uint64_t acc, uint64_t input)
+{
+  acc += input * kPrime64_2;
+  acc = HashRotl(acc, 31);
+  return acc * kPrime64_1;
+}
+
+inline uint64_t
+HashMerge(uint64_t acc, uint64_t lane)
+{
+  acc ^= HashRound(0, lane);
+  return acc * kPrime64_1 + kPrime64_4;
+}
+
+uint64_t
+Hash64(const void* data, uint64_t bytes, uint64_t seed)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  const uint8_t* end = p + bytes;
+  uint64_t h;
+
+  if (bytes >= 32) {
+    uint64_t lane[4] = {seed + kPrime64_1 + kPrime64_2, seed + kPrime64_2,
+                        seed, seed - kPrime64_1};
+    for (; end - p >= 32; p += 32) {
+      for (int i = 0; i < 4; ++i) {
+        lane[i] = HashRound(lane[i], HashRead64(p + 8 * i));
+      }
+    }
+    h = HashRotl(lane[0], 1) + HashRotl(lane[1], 7) + HashRotl(lane[2], 12) +
+        HashRotl(lane[3], 18);
+    for (int i = 0; i < 4; ++i) h = HashMerge(h, lane[i]);
+  } else {
+    h = seed + kPrime64_5;
+  }
+
+  h += bytes;
+  for (; end - p >= 8; p += 8) {
+    h ^= HashRound(0, HashRead64(p));
+    h = HashRotl(h, 27) * kPrime64_1 + kPrime64_4;
+  }
+  if (end - p >= 4) {
+    h ^= HashRead32(p) * kPrime64_1;
+    h = HashRotl(h, 23) * kPrime64_2 + kPrime64_3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * kPrime64_5;
+    h = HashRotl(h, 11) * kPrime64_1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
@@ -0,0 +1,34 @@
+#include <cassert>
+#include <cstdio>
+
+#include "hash.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+int
+main()
+{
+  // Reference XXH64 digests, seed 0
+  ASSERT_TRUE(Hash64("", 0, 0) == 0xEF46DB3751D8E999ull);
+  ASSERT_TRUE(Hash64("a", 1, 0) == 0xD24EC4F1A98C6E5Bull);
+  ASSERT_TRUE(Hash64("abc", 3, 0) == 0x44BC2CF5AD770999ull);
+  const char* text = "Nobody inspects the spammish repetition";
+  ASSERT_TRUE(Hash64(text, strlen(text), 0) == 0xFBCEA83C8A378BF1ull);
+
+  // Every byte of a multi-stripe buffer contributes
+  uint8_t buffer[257] = {};
+  uint64_t base = Hash64(buffer, sizeof(buffer), 0);
+  for (uint64_t i = 0; i < sizeof(buffer); ++i) {
+    buffer[i] ^= 1;
+    ASSERT_TRUE(Hash64(buffer, sizeof(buffer), 0) != base);
+    buffer[i] ^= 1;
+  }
+
+  // Chaining is order dependent
+  uint64_t ab = Hash64("b", 1, Hash64("a", 1, 0));
+  uint64_t ba = Hash64("a", 1, Hash64("b", 1, 0));
+  ASSERT_TRUE(ab != ba);
+
+  printf("hash ok\n");
+  return 0;
+}
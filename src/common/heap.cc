@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary min-heap over a caller owned array, the lowest weight is first[0].
+// Promoted from example/heap with the comparison flipped for searches.
+struct HeapNode {
+  uint32_t weight;
+  uint32_t data;
+};
+
+// Move value up from hole_index until its parent is not heavier
+void
+HeapSiftUp(HeapNode* first, uint64_t hole_index, HeapNode value)
+{
+  while (hole_index) {
+    uint64_t parent = (hole_index - 1) / 2;
+    if (first[parent].weight <= value.weight) break;
+    first[hole_index] = first[parent];
+    hole_index = parent;
+  }
+  first[hole_index] = value;
+}
+
+// Move value down from hole_index until no child is lighter
+void
+HeapSiftDown(HeapNode* first, uint64_t hole_index, uint64_t len, HeapNode value)
+{
+  for (;;) {
+    uint64_t child = 2 * hole_index + 1;
+    if (child >= len) break;
+    if (child + 1 < len && first[child + 1].weight < first[child].weight) {
+      child += 1;
+    }
+    if (value.weight <= first[child].weight) break;
+    first[hole_index] = first[child];
+    hole_index = child;
+  }
+  first[hole_index] = value;
+}
+
+void
+HeapPush(HeapNode* first, uint64_t* len, HeapNode value)
+{
+  HeapSiftUp(first, *len, value);
+  *len += 1;
+}
+
+// Requires a non-empty heap
+HeapNode
+HeapPop(HeapNode* first, uint64_t* len)
+{
+  HeapNode result = first[0];
+  *len -= 1;
+  if (*len) HeapSiftDown(first, 0, *len, first[*len]);
+  return result;
+}
+
+void
+HeapMake(HeapNode* first, uint64_t len)
+{
+  if (len < 2) return;
+  for (uint64_t parent = len / 2; parent-- > 0;) {
+    HeapSiftDown(first, parent, len, first[parent]);
+  }
+}
@@ -0,0 +1,67 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include "heap.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+#define ARRAY_LENGTH(x) (sizeof(x) / sizeof(x[0]))
+
+void
+MakeAndDrain()
+{
+  const uint32_t weight[] = {
+      571231283, 318,  188,  97123, 947213, 523213, 5713, 977123, 853213,
+      5712,      38,   187,  971,   9413,   5223,   513,  9712,   53213,
+  };
+  HeapNode test_array[ARRAY_LENGTH(weight)];
+  for (uint32_t i = 0; i < ARRAY_LENGTH(weight); ++i) {
+    test_array[i] = HeapNode{weight[i], i};
+  }
+  uint64_t len = ARRAY_LENGTH(test_array);
+  HeapMake(test_array, len);
+
+  uint32_t val = 0;
+  while (len) {
+    HeapNode next = HeapPop(test_array, &len);
+    ASSERT_TRUE(next.weight >= val);
+    val = next.weight;
+  }
+  ASSERT_TRUE(val == 571231283);
+}
+
+void
+PushPop()
+{
+  static HeapNode heap[4096];
+  uint64_t len = 0;
+  srand(7);
+  for (uint32_t i = 0; i < ARRAY_LENGTH(heap); ++i) {
+    HeapPush(heap, &len, HeapNode{(uint32_t)rand() % 1000, i});
+  }
+  ASSERT_TRUE(len == ARRAY_LENGTH(heap));
+
+  // Interleave pops with pushes no lighter than the last pop
+  uint32_t val = 0;
+  for (int i = 0; i < 1000; ++i) {
+    HeapNode next = HeapPop(heap, &len);
+    ASSERT_TRUE(next.weight >= val);
+    val = next.weight;
+    HeapPush(heap, &len, HeapNode{val + (uint32_t)rand() % 10, 0});
+  }
+  while (len) {
+    HeapNode next = HeapPop(heap, &len);
+    ASSERT_TRUE(next.weight >= val);
+    val = next.weight;
+  }
+}
+
+int
+main()
+{
+  MakeAndDrain();
+  PushPop();
+  printf("heap ok\n");
+  return 0;
+}
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "platform/platform.cc"
+
+// Fixed pool of worker threads running short jobs.
+// Each worker owns a deque: it pushes and pops jobs at the bottom, idle
+// workers steal from the top (Chase-Lev). The thread calling
+// JobInitialize is worker 0 and runs jobs while it waits on a counter.
+
+// Including the calling thread
+#define MAX_JOB_WORKER 16
+// Jobs queued per worker, power of 2
+#define JOB_DEQUE 1024
+// Job storage per worker, reused round robin. A slot is free again once its
+// job started, JOB_DEQUE queued jobs leave plenty of free slots.
+#define MAX_JOB 4096
+// Failed steal rounds before an idle worker sleeps
+#define JOB_SPIN 64
+// Sleep bound, covers a wakeup lost to a race with the sleeping flag
+#define JOB_SLEEP_USEC 1000
+
+static_assert(MAX_JOB > JOB_DEQUE + MAX_JOB_WORKER,
+              "JobAlloc may find no free slot");
+
+// Runs over [begin, end) of a range, or begin = end = 0 for single jobs
+typedef void (*JobFunc)(void* arg, uint64_t begin, uint64_t end);
+
+// Number of submitted jobs that have not finished
+struct JobCounter {
+  std::atomic<uint64_t> pending;
+};
+
+struct JobData {
+  JobFunc func;
+  void* arg;
+  uint64_t begin;
+  uint64_t end;
+  // Decremented when the job finishes
+  JobCounter* counter;
+  // The job does not start until this reaches zero
+  JobCounter* dependency;
+};
+
+struct Job {
+  JobData data;
+  // Set by JobAlloc, cleared once JobExecute copied data out
+  std::atomic<bool> queued;
+};
+
+struct JobDeque {
+  alignas(64) std::atomic<int64_t> top;
+  alignas(64) std::atomic<int64_t> bottom;
+  std::atomic<Job*> job[JOB_DEQUE];
+};
+
+struct JobWorker {
+  JobDeque deque;
+  Job pool[MAX_JOB];
+  uint64_t used_pool;
+  ThreadInfo thread;
+  EventLoop loop;
+  EventWakeup wakeup;
+  std::atomic<bool> sleeping;
+  uint64_t steal_seed;
+};
+
+struct JobSystem {
+  uint64_t worker_count;
+  std::atomic<bool> running;
+};
+
+static JobSystem kJobSystem;
+static JobWorker kJobWorker[MAX_JOB_WORKER];
+static thread_local uint64_t kJobWorkerIndex;
+
+bool
+JobDequePush(JobDeque* d, Job* job)
+{
+  int64_t b = d->bottom.load(std::memory_order_relaxed);
+  int64_t t = d->top.load(std::memory_order_acquire);
+  if (b - t >= JOB_DEQUE) return false;
+  d->job[b % JOB_DEQUE].store(job, std::memory_order_relaxed);
+  d->bottom.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+// Owner only, newest first
+Job*
+JobDequePop(JobDeque* d)
+{
+  int64_t b = d->bottom.load(std::memory_order_relaxed) - 1;
+  d->bottom.store(b, std::memory_order_seq_cst);
+  int64_t t = d->top.load(std::memory_order_seq_cst);
+  if (t > b) {
+    d->bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job* job = d->job[b % JOB_DEQUE].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last job, race the thieves for it
+    if (!d->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    d->bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+// Any thread, oldest first
+Job*
+JobDequeSteal(JobDeque* d)
+{
+  int64_t t = d->top.load(std::memory_order_seq_cst);
+  int64_t b = d->bottom.load(std::memory_order_seq_cst);
+  if (t >= b) return nullptr;
+
+  Job* job = d->job[t % JOB_DEQUE].load(std::memory_order_acquire);
+  if (!d->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  return job;
+}
+
+// Job from the own deque, else from a victim picked round robin from a
+// per-worker offset
+Job*
+JobNext(JobWorker* w)
+{
+  Job* job = JobDequePop(&w->deque);
+  if (job) return job;
+
+  uint64_t count = kJobSystem.worker_count;
+  w->steal_seed += 1;
+  for (uint64_t i = 0; i < count; ++i) {
+    JobWorker* victim = &kJobWorker[(w->steal_seed + i) % count];
+    if (victim == w) continue;
+    job = JobDequeSteal(&victim->deque);
+    if (job) return job;
+  }
+  return nullptr;
+}
+
+void
+JobWake()
+{
+  for (uint64_t i = 1; i < kJobSystem.worker_count; ++i) {
+    JobWorker* w = &kJobWorker[i];
+    if (w->sleeping.load(std::memory_order_relaxed)) {
+      w->sleeping.store(false, std::memory_order_relaxed);
+      platform::event_signal(w->wakeup);
+    }
+  }
+}
+
+void JobExecute(JobWorker* w, Job* job);
+
+// Runs job now when the deque is full
+void
+JobPush(JobWorker* w, Job* job)
+{
+  if (!JobDequePush(&w->deque, job)) {
+    JobExecute(w, job);
+    return;
+  }
+  JobWake();
+}
+
+void
+JobExecute(JobWorker* w, Job* job)
+{
+  // Copied out so the owner may reuse the slot while this job waits or runs
+  JobData run = job->data;
+  job->queued.store(false, std::memory_order_release);
+
+  // Not ready, run other jobs meanwhile since they may be what it waits on
+  JobCounter* dependency = run.dependency;
+  while (dependency && dependency->pending.load(std::memory_order_acquire)) {
+    Job* other = JobNext(w);
+    if (other) {
+      JobExecute(w, other);
+    } else {
+      platform::thread_yield();
+    }
+  }
+
+  run.func(run.arg, run.begin, run.end);
+  if (run.counter) {
+    run.counter->pending.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+// Runs one queued job on the calling worker, false when none was found
+bool
+JobRunOne()
+{
+  JobWorker* w = &kJobWorker[kJobWorkerIndex];
+  Job* job = JobNext(w);
+  if (!job) return false;
+  JobExecute(w, job);
+  return true;
+}
+
+uint64_t
+JobWorkerMain(void* arg)
+{
+  kJobWorkerIndex = (uint64_t)(uintptr_t)arg;
+  JobWorker* w = &kJobWorker[kJobWorkerIndex];
+  uint64_t idle = 0;
+  while (kJobSystem.running.load(std::memory_order_acquire)) {
+    if (JobRunOne()) {
+      idle = 0;
+      continue;
+    }
+    if (++idle < JOB_SPIN) {
+      platform::thread_yield();
+      continue;
+    }
+    w->sleeping.store(true, std::memory_order_relaxed);
+    uint64_t token;
+    platform::event_wait(&w->loop, JOB_SLEEP_USEC, &token, 1);
+    w->sleeping.store(false, std::memory_order_relaxed);
+    idle = 0;
+  }
+  return 0;
+}
+
+// Starts worker_count - 1 threads, the caller is worker 0
+bool
+JobInitialize(uint64_t worker_count)
+{
+  if (worker_count < 1) worker_count = 1;
+  if (worker_count > MAX_JOB_WORKER) worker_count = MAX_JOB_WORKER;
+
+  kJobSystem.worker_count = worker_count;
+  kJobSystem.running.store(true, std::memory_order_release);
+  kJobWorkerIndex = 0;
+  for (uint64_t i = 1; i < worker_count; ++i) {
+    JobWorker* w = &kJobWorker[i];
+    w->steal_seed = i;
+    if (!platform::event_create(&w->loop) ||
+        !platform::event_add_wakeup(&w->loop, 0, &w->wakeup)) {
+      return false;
+    }
+    w->thread = ThreadInfo{};
+    w->thread.func = JobWorkerMain;
+    w->thread.arg = (void*)(uintptr_t)i;
+    if (!platform::thread_create(&w->thread)) return false;
+  }
+  return true;
+}
+
+// Queued jobs must be finished (JobWait) first
+void
+JobShutdown()
+{
+  kJobSystem.running.store(false, std::memory_order_release);
+  for (uint64_t i = 1; i < kJobSystem.worker_count; ++i) {
+    platform::event_signal(kJobWorker[i].wakeup);
+  }
+  for (uint64_t i = 1; i < kJobSystem.worker_count; ++i) {
+    platform::thread_join(&kJobWorker[i].thread);
+    platform::event_destroy(&kJobWorker[i].loop);
+  }
+  kJobSystem.worker_count = 0;
+}
+
+Job*
+JobAlloc(JobFunc func, void* arg, uint64_t begin, uint64_t end,
+         JobCounter* counter, JobCounter* dependency)
+{
+  JobWorker* w = &kJobWorker[kJobWorkerIndex];
+  // Skip slots whose job has not started. Those are the ones in the deque
+  // and ones claimed by a thief, far fewer than MAX_JOB.
+  Job* job;
+  do {
+    job = &w->pool[w->used_pool++ % MAX_JOB];
+  } while (job->queued.load(std::memory_order_acquire));
+  job->data = JobData{func, arg, begin, end, counter, dependency};
+  job->queued.store(true, std::memory_order_relaxed);
+  if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+  return job;
+}
+
+// Queues func(arg, 0, 0). counter (optional) is incremented now and
+// decremented once it ran; it will not start before dependency
+// (optional) reaches zero.
+void
+JobSubmit(JobFunc func, void* arg, JobCounter* counter,
+          JobCounter* dependency = nullptr)
+{
+  Job* job = JobAlloc(func, arg, 0, 0, counter, dependency);
+  JobPush(&kJobWorker[kJobWorkerIndex], job);
+}
+
+// Queues func over [0, count) in ranges of at most grain, e.g.
+// JobParallelFor(kUsedUnit, 16, UpdateUnits, nullptr, &counter) for a
+// DECLARE_ARRAY.
+void
+JobParallelFor(uint64_t count, uint64_t grain, JobFunc func, void* arg,
+               JobCounter* counter, JobCounter* dependency = nullptr)
+{
+  if (!grain) grain = 1;
+  JobWorker* w = &kJobWorker[kJobWorkerIndex];
+  for (uint64_t begin = 0; begin < count; begin += grain) {
+    uint64_t end = begin + grain < count ? begin + grain : count;
+    JobPush(w, JobAlloc(func, arg, begin, end, counter, dependency));
+  }
+}
+
+// Runs queued jobs until counter reaches zero
+void
+JobWait(JobCounter* counter)
+{
+  while (counter->pending.load(std::memory_order_acquire)) {
+    if (!JobRunOne()) platform::thread_yield();
+  }
+}
@@ -0,0 +1,142 @@
+#include <cassert>
+#include <cstdio>
+
+#include "array.cc"
+#include "job.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+struct Particle {
+  uint64_t value;
+  uint64_t squared;
+  uint64_t worker;
+};
+
+DECLARE_ARRAY(Particle, 1 << 16);
+
+void
+Square(void*, uint64_t begin, uint64_t end)
+{
+  for (uint64_t i = begin; i < end; ++i) {
+    kParticle[i].squared = kParticle[i].value * kParticle[i].value;
+    kParticle[i].worker = kJobWorkerIndex;
+  }
+}
+
+void
+ParallelFor()
+{
+  for (uint64_t i = 0; i < kMaxParticle; ++i) UseParticle()->value = i;
+
+  JobCounter counter = {};
+  JobParallelFor(kUsedParticle, 256, Square, nullptr, &counter);
+  JobWait(&counter);
+  ASSERT_TRUE(counter.pending == 0);
+
+  uint64_t ran[MAX_JOB_WORKER] = {};
+  for (uint64_t i = 0; i < kUsedParticle; ++i) {
+    ASSERT_TRUE(kParticle[i].squared == i * i);
+    ran[kParticle[i].worker] += 1;
+  }
+  for (uint64_t i = 0; i < kJobSystem.worker_count; ++i) {
+    printf("worker %lu ran %lu\n", i, ran[i]);
+  }
+}
+
+// Each stage reads what the previous stage wrote
+static uint64_t kStage[3];
+
+void
+StageOne(void*, uint64_t, uint64_t)
+{
+  kStage[0] = 7;
+}
+
+void
+StageTwo(void*, uint64_t, uint64_t)
+{
+  kStage[1] = kStage[0] * 3;
+}
+
+void
+StageThree(void*, uint64_t, uint64_t)
+{
+  kStage[2] = kStage[1] + 1;
+}
+
+void
+Dependencies()
+{
+  kStage[0] = kStage[1] = kStage[2] = 0;
+  JobCounter one = {}, two = {}, three = {};
+  // Submitted in reverse: the owner pops StageOne first, thieves steal
+  // StageThree first and wait on it
+  JobSubmit(StageThree, nullptr, &three, &two);
+  JobSubmit(StageTwo, nullptr, &two, &one);
+  JobSubmit(StageOne, nullptr, &one);
+  JobWait(&three);
+  ASSERT_TRUE(kStage[2] == 22);
+}
+
+// With one worker nothing is stolen and the newest job is popped first:
+// StageThree starts first and runs StageTwo, which runs StageOne, while it
+// waits. Run early, a stage reads 0 and kStage[2] is off.
+void
+DependencyWait()
+{
+  kStage[0] = kStage[1] = kStage[2] = 0;
+  JobCounter one = {}, two = {}, three = {};
+  JobSubmit(StageOne, nullptr, &one);
+  JobSubmit(StageTwo, nullptr, &two, &one);
+  JobSubmit(StageThree, nullptr, &three, &two);
+  JobWait(&three);
+  ASSERT_TRUE(kStage[2] == 22);
+  ASSERT_TRUE(one.pending == 0 && two.pending == 0);
+}
+
+// Jobs submitting jobs: a tree of 4^5 leaves
+static std::atomic<uint64_t> kLeaves;
+
+void
+Spawn(void* arg, uint64_t, uint64_t)
+{
+  uint64_t depth = (uintptr_t)arg;
+  if (!depth) {
+    kLeaves.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  JobCounter children = {};
+  for (int i = 0; i < 4; ++i) {
+    JobSubmit(Spawn, (void*)(uintptr_t)(depth - 1), &children);
+  }
+  JobWait(&children);
+}
+
+void
+Nested()
+{
+  JobCounter root = {};
+  JobSubmit(Spawn, (void*)(uintptr_t)5, &root);
+  JobWait(&root);
+  ASSERT_TRUE(kLeaves == 1024);
+}
+
+int
+main()
+{
+  ASSERT_TRUE(JobInitialize(4));
+  ParallelFor();
+  Dependencies();
+  Nested();
+  JobShutdown();
+
+  // No workers, everything runs on the caller
+  ASSERT_TRUE(JobInitialize(1));
+  DependencyWait();
+  kLeaves = 0;
+  Nested();
+  JobShutdown();
+
+  printf("job ok\n");
+  return 0;
+}
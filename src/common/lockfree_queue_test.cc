@@ -0,0 +1,191 @@
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+
+#include "platform/platform.cc"
+#include "queue.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+struct Message {
+  uint32_t producer;
+  uint32_t sequence;
+};
+
+struct Job {
+  uint32_t producer;
+  uint32_t sequence;
+};
+
+DECLARE_SPSC_QUEUE(Message, 1024);
+DECLARE_MPMC_QUEUE(Job, 1024);
+
+// Each cursor has whole cache lines to itself
+static_assert(sizeof(MessageCursor) == 2 * QUEUE_CACHE_LINE &&
+                  alignof(MessageCursor) == QUEUE_CACHE_LINE,
+              "SPSC sides share a cache line");
+static_assert(sizeof(JobCursor) == 2 * QUEUE_CACHE_LINE &&
+                  alignof(JobCursor) == QUEUE_CACHE_LINE,
+              "MPMC cursors share a cache line");
+
+constexpr uint32_t kMessages = 1 << 21;
+constexpr uint32_t kBatch = 32;
+constexpr int kProducers = 4;
+constexpr int kConsumers = 4;
+constexpr uint32_t kJobs = 1 << 19;
+
+static std::atomic<uint64_t> kJobsPopped;
+static uint64_t kConsumerSum[kConsumers];
+
+double
+Seconds(const timespec& start)
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+void
+SingleThreaded()
+{
+  Message batch[kBatch];
+  for (uint32_t i = 0; i < kBatch; ++i) batch[i] = Message{0, i};
+  ASSERT_TRUE(CountMessage() == 0);
+  ASSERT_TRUE(PopMessage().sequence == 0);
+
+  // Fill to capacity, the next push fails
+  for (uint64_t i = 0; i < kMaxMessage; i += kBatch) {
+    ASSERT_TRUE(PushBatchMessage(batch, kBatch) == kBatch);
+  }
+  ASSERT_TRUE(!PushMessage(Message{}));
+  ASSERT_TRUE(CountMessage() == kMaxMessage);
+
+  Message out[kBatch * 2];
+  ASSERT_TRUE(PopBatchMessage(out, 5) == 5);
+  ASSERT_TRUE(out[4].sequence == 4);
+  ASSERT_TRUE(PushBatchMessage(batch, kBatch) == 5);
+  while (PopBatchMessage(out, kBatch * 2))
+    ;
+  ASSERT_TRUE(CountMessage() == 0);
+
+  for (uint64_t i = 0; i < kMaxJob; ++i) ASSERT_TRUE(PushJob(Job{0, 1}));
+  ASSERT_TRUE(!PushJob(Job{}));
+  ASSERT_TRUE(CountJob() == kMaxJob);
+  Job job;
+  for (uint64_t i = 0; i < kMaxJob; ++i) ASSERT_TRUE(TryPopJob(&job));
+  ASSERT_TRUE(!TryPopJob(&job));
+  ASSERT_TRUE(PopJob().sequence == 0);
+}
+
+uint64_t
+SpscProducer(void*)
+{
+  Message batch[kBatch];
+  for (uint32_t sent = 0; sent < kMessages;) {
+    for (uint32_t i = 0; i < kBatch; ++i) batch[i] = Message{0, sent + i};
+    uint32_t pushed = 0;
+    while (pushed < kBatch) {
+      pushed += PushBatchMessage(batch + pushed, kBatch - pushed);
+      if (pushed < kBatch) platform::thread_yield();
+    }
+    sent += kBatch;
+  }
+  return 0;
+}
+
+void
+Spsc()
+{
+  static ThreadInfo producer;
+  producer.func = SpscProducer;
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  platform::thread_create(&producer);
+
+  Message out[kBatch];
+  uint32_t expect = 0;
+  while (expect < kMessages) {
+    uint64_t n = PopBatchMessage(out, kBatch);
+    if (!n) platform::thread_yield();
+    for (uint64_t i = 0; i < n; ++i) {
+      ASSERT_TRUE(out[i].sequence == expect);
+      expect += 1;
+    }
+  }
+  platform::thread_join(&producer);
+  double s = Seconds(start);
+  printf("spsc 1x1 batch %u: %.1f M/s\n", kBatch, kMessages / s / 1e6);
+}
+
+uint64_t
+MpmcProducer(void* arg)
+{
+  uint32_t producer = (uint32_t)(uintptr_t)arg;
+  for (uint32_t i = 0; i < kJobs; ++i) {
+    while (!PushJob(Job{producer, i})) platform::thread_yield();
+  }
+  return 0;
+}
+
+uint64_t
+MpmcConsumer(void* arg)
+{
+  uint64_t consumer = (uintptr_t)arg;
+  // Jobs of each producer arrive in order at any one consumer
+  int64_t last[kProducers];
+  for (int i = 0; i < kProducers; ++i) last[i] = -1;
+  uint64_t sum = 0;
+  while (kJobsPopped.load(std::memory_order_relaxed) < kJobs * kProducers) {
+    Job job;
+    if (!TryPopJob(&job)) {
+      platform::thread_yield();
+      continue;
+    }
+    ASSERT_TRUE(job.producer < kProducers);
+    ASSERT_TRUE((int64_t)job.sequence > last[job.producer]);
+    last[job.producer] = job.sequence;
+    sum += job.sequence;
+    kJobsPopped.fetch_add(1, std::memory_order_relaxed);
+  }
+  kConsumerSum[consumer] = sum;
+  return 0;
+}
+
+void
+Mpmc()
+{
+  static ThreadInfo producer[kProducers];
+  static ThreadInfo consumer[kConsumers];
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < kConsumers; ++i) {
+    consumer[i].func = MpmcConsumer;
+    consumer[i].arg = (void*)(uintptr_t)i;
+    platform::thread_create(&consumer[i]);
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    producer[i].func = MpmcProducer;
+    producer[i].arg = (void*)(uintptr_t)i;
+    platform::thread_create(&producer[i]);
+  }
+  for (int i = 0; i < kProducers; ++i) platform::thread_join(&producer[i]);
+  for (int i = 0; i < kConsumers; ++i) platform::thread_join(&consumer[i]);
+  double s = Seconds(start);
+
+  uint64_t sum = 0;
+  for (int i = 0; i < kConsumers; ++i) sum += kConsumerSum[i];
+  ASSERT_TRUE(sum == (uint64_t)kProducers * kJobs * (kJobs - 1) / 2);
+  ASSERT_TRUE(CountJob() == 0);
+  printf("mpmc %dx%d: %.1f M/s\n", kProducers, kConsumers,
+         (double)kJobs * kProducers / s / 1e6);
+}
+
+int
+main()
+{
+  SingleThreaded();
+  Spsc();
+  Mpmc();
+  printf("lockfree queue ok\n");
+  return 0;
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "platform/platform.cc"
+
+// Nested timing zones from rdtsc().
+// Each thread records into its own ring, so zones cost two rdtsc and no
+// synchronization. Rings are read by the overlay (main thread only) and by
+// ProfileWriteChromeTrace, which expects the other threads to be idle.
+//
+//   void Update() {
+//     PROFILE_SCOPE("update");
+//     ...
+//   }
+
+// Threads that may record, including the main thread
+#define MAX_PROFILE_THREAD 16
+// Zones kept per thread, power of 2
+#define PROFILE_RING 4096
+#define MAX_PROFILE_DEPTH 16
+
+struct ProfileZone {
+  const char* name;
+  uint64_t begin_tsc;
+  // 0 while the zone is open
+  uint64_t end_tsc;
+  uint32_t depth;
+  // kProfile.frame when the zone began
+  uint32_t frame;
+};
+
+struct ProfileThread {
+  ProfileZone zone[PROFILE_RING];
+  // Zones begun
+  uint64_t write;
+  uint32_t depth;
+  // Ring positions of the open zones
+  uint64_t open[MAX_PROFILE_DEPTH];
+  // Zones begun past MAX_PROFILE_DEPTH and not yet ended, not recorded
+  uint32_t dropped;
+};
+
+struct Profile {
+  std::atomic<uint32_t> frame;
+  std::atomic<uint32_t> thread_count;
+  ProfileThread thread[MAX_PROFILE_THREAD];
+};
+
+static Profile kProfile;
+// 1 + index into kProfile.thread, 0 until the thread first records
+static thread_local uint32_t kProfileThread;
+
+ProfileThread*
+ProfileGetThread()
+{
+  if (!kProfileThread) {
+    uint32_t index = kProfile.thread_count.fetch_add(1);
+    // Threads past the limit are not recorded
+    if (index >= MAX_PROFILE_THREAD) return nullptr;
+    kProfileThread = index + 1;
+  }
+  return &kProfile.thread[kProfileThread - 1];
+}
+
+void
+ProfileBegin(const char* name)
+{
+  ProfileThread* t = ProfileGetThread();
+  if (!t) return;
+  if (t->depth == MAX_PROFILE_DEPTH) {
+    t->dropped += 1;
+    return;
+  }
+
+  uint64_t index = t->write++;
+  ProfileZone* zone = &t->zone[index % PROFILE_RING];
+  zone->name = name;
+  zone->end_tsc = 0;
+  zone->depth = t->depth;
+  zone->frame = kProfile.frame.load(std::memory_order_relaxed);
+  t->open[t->depth++] = index;
+  zone->begin_tsc = rdtsc();
+}
+
+void
+ProfileEnd()
+{
+  uint64_t tsc = rdtsc();
+  ProfileThread* t = ProfileGetThread();
+  if (!t) return;
+  // Ends the innermost zone, the dropped ones are the innermost
+  if (t->dropped) {
+    t->dropped -= 1;
+    return;
+  }
+  if (!t->depth) return;
+
+  uint64_t index = t->open[--t->depth];
+  // Overwritten by newer zones while open
+  if (t->write - index > PROFILE_RING) return;
+  t->zone[index % PROFILE_RING].end_tsc = tsc;
+}
+
+struct ProfileScope {
+  ProfileScope(const char* name)
+  {
+    ProfileBegin(name);
+  }
+  ~ProfileScope()
+  {
+    ProfileEnd();
+  }
+};
+
+#define PROFILE_CONCAT_(x, y) x##y
+#define PROFILE_CONCAT(x, y) PROFILE_CONCAT_(x, y)
+#define PROFILE_SCOPE(name) \
+  ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+// Starts the next frame, zones are grouped by the frame they began in
+void
+ProfileFrame()
+{
+  kProfile.frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Closed zones of thread that began in frame, oldest first.
+// Returns the count written to out.
+uint64_t
+ProfileFrameZones(uint32_t thread, uint32_t frame, ProfileZone* out,
+                  uint64_t max_out)
+{
+  if (thread >= MAX_PROFILE_THREAD) return 0;
+  const ProfileThread* t = &kProfile.thread[thread];
+
+  // Walk back to the frame's first zone
+  uint64_t first = t->write;
+  while (first && t->write - first < PROFILE_RING) {
+    const ProfileZone* zone = &t->zone[(first - 1) % PROFILE_RING];
+    if ((int32_t)(zone->frame - frame) < 0) break;
+    first -= 1;
+  }
+
+  uint64_t count = 0;
+  for (uint64_t i = first; i < t->write && count < max_out; ++i) {
+    const ProfileZone* zone = &t->zone[i % PROFILE_RING];
+    if (zone->frame != frame) break;
+    if (!zone->end_tsc) continue;
+    out[count++] = *zone;
+  }
+  return count;
+}
+
+// Every recorded zone as Chrome trace events (chrome://tracing, Perfetto)
+bool
+ProfileWriteChromeTrace(const char* path, const Clock_t* clock)
+{
+  FILE* f = fopen(path, "w");
+  if (!f) return false;
+
+  uint32_t thread_count = kProfile.thread_count.load();
+  if (thread_count > MAX_PROFILE_THREAD) thread_count = MAX_PROFILE_THREAD;
+
+  // Timestamps relative to the oldest zone still recorded
+  uint64_t origin = UINT64_MAX;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    const ProfileThread* t = &kProfile.thread[i];
+    uint64_t first = t->write > PROFILE_RING ? t->write - PROFILE_RING : 0;
+    if (first == t->write) continue;
+    uint64_t tsc = t->zone[first % PROFILE_RING].begin_tsc;
+    if (tsc < origin) origin = tsc;
+  }
+
+  fputs("{\"traceEvents\":[", f);
+  bool comma = false;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    const ProfileThread* t = &kProfile.thread[i];
+    uint64_t first = t->write > PROFILE_RING ? t->write - PROFILE_RING : 0;
+    for (uint64_t j = first; j < t->write; ++j) {
+      const ProfileZone* zone = &t->zone[j % PROFILE_RING];
+      if (!zone->end_tsc) continue;
+      uint64_t ts = platform::tscdelta_to_usec(clock, zone->begin_tsc - origin);
+      uint64_t dur =
+          platform::tscdelta_to_usec(clock, zone->end_tsc - zone->begin_tsc);
+      fprintf(f,
+              "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,"
+              "\"pid\":0,\"tid\":%u,\"args\":{\"frame\":%u}}",
+              comma ? "," : "", zone->name, ts, dur, i, zone->frame);
+      comma = true;
+    }
+  }
+  fputs("\n]}\n", f);
+
+  bool ok = !ferror(f);
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "profile.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+static Clock_t kClock;
+
+void
+Spin(uint64_t usec)
+{
+  uint64_t start = rdtsc();
+  while (platform::tscdelta_to_usec(&kClock, rdtsc() - start) < usec)
+    ;
+}
+
+void
+Inner()
+{
+  PROFILE_SCOPE("inner");
+  Spin(200);
+}
+
+void
+Nesting()
+{
+  ProfileFrame();
+  uint32_t frame = kProfile.frame;
+  {
+    PROFILE_SCOPE("outer");
+    Inner();
+    Inner();
+  }
+  ProfileFrame();
+  {
+    PROFILE_SCOPE("next");
+  }
+
+  ProfileZone zone[8];
+  uint64_t count = ProfileFrameZones(0, frame, zone, 8);
+  ASSERT_TRUE(count == 3);
+  ASSERT_TRUE(strcmp(zone[0].name, "outer") == 0);
+  ASSERT_TRUE(zone[0].depth == 0);
+  ASSERT_TRUE(strcmp(zone[1].name, "inner") == 0);
+  ASSERT_TRUE(zone[1].depth == 1 && zone[2].depth == 1);
+
+  // Children lie within the parent, in order
+  ASSERT_TRUE(zone[0].begin_tsc <= zone[1].begin_tsc);
+  ASSERT_TRUE(zone[1].end_tsc <= zone[2].begin_tsc);
+  ASSERT_TRUE(zone[2].end_tsc <= zone[0].end_tsc);
+  uint64_t outer =
+      platform::tscdelta_to_usec(&kClock, zone[0].end_tsc - zone[0].begin_tsc);
+  ASSERT_TRUE(outer >= 400);
+
+  ASSERT_TRUE(ProfileFrameZones(0, frame + 1, zone, 8) == 1);
+  ASSERT_TRUE(ProfileFrameZones(0, frame + 2, zone, 8) == 0);
+}
+
+void
+RingWraps()
+{
+  ProfileFrame();
+  uint32_t frame = kProfile.frame;
+  for (int i = 0; i < 3 * PROFILE_RING; ++i) {
+    PROFILE_SCOPE("many");
+  }
+  ProfileZone zone[8];
+  ASSERT_TRUE(ProfileFrameZones(0, frame, zone, 8) == 8);
+  ASSERT_TRUE(ProfileFrameZones(0, frame - 1, zone, 8) == 0);
+}
+
+// Zones nested past the max are dropped, their ends leave the recorded
+// ones open
+void
+TooDeep()
+{
+  ProfileFrame();
+  uint32_t frame = kProfile.frame;
+  for (int i = 0; i < MAX_PROFILE_DEPTH + 3; ++i) ProfileBegin("deep");
+  for (int i = 0; i < MAX_PROFILE_DEPTH + 3; ++i) {
+    ASSERT_TRUE(kProfile.thread[0].depth ==
+                (uint32_t)std::min(MAX_PROFILE_DEPTH + 3 - i,
+                                   MAX_PROFILE_DEPTH));
+    ProfileEnd();
+  }
+  ASSERT_TRUE(kProfile.thread[0].depth == 0);
+  ASSERT_TRUE(kProfile.thread[0].dropped == 0);
+
+  ProfileZone zone[MAX_PROFILE_DEPTH + 1];
+  uint64_t count = ProfileFrameZones(0, frame, zone, MAX_PROFILE_DEPTH + 1);
+  ASSERT_TRUE(count == MAX_PROFILE_DEPTH);
+  // Each zone encloses the next deeper one
+  for (uint64_t i = 1; i < count; ++i) {
+    ASSERT_TRUE(zone[i].depth == i);
+    ASSERT_TRUE(zone[i].end_tsc <= zone[i - 1].end_tsc);
+  }
+}
+
+uint64_t
+Worker(void*)
+{
+  PROFILE_SCOPE("worker");
+  Spin(100);
+  return 0;
+}
+
+void
+ChromeTrace()
+{
+  static ThreadInfo thread;
+  thread.func = Worker;
+  platform::thread_create(&thread);
+  platform::thread_join(&thread);
+  ASSERT_TRUE(kProfile.thread_count == 2);
+
+  const char* path = "/tmp/profile_test_trace.json";
+  ASSERT_TRUE(ProfileWriteChromeTrace(path, &kClock));
+  FILE* f = fopen(path, "r");
+  ASSERT_TRUE(f);
+  static char json[1 << 20];
+  size_t len = fread(json, 1, sizeof(json) - 1, f);
+  json[len] = 0;
+  fclose(f);
+  ASSERT_TRUE(strncmp(json, "{\"traceEvents\":[", 16) == 0);
+  ASSERT_TRUE(strstr(json, "\"name\":\"worker\",\"ph\":\"X\""));
+  ASSERT_TRUE(strstr(json, "\"tid\":1"));
+  ASSERT_TRUE(strstr(json, "\n]}\n"));
+  remove(path);
+}
+
+int
+main()
+{
+  platform::clock_init(1000, &kClock);
+  Nesting();
+  RingWraps();
+  TooDeep();
+  ChromeTrace();
+  printf("profile ok\n");
+  return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 
 // For the given type defines:
@@ -41,3 +42,184 @@
     return kWrite##type - kRead##type;                    \
   }
 
+// Cache line size used to keep producer and consumer indices apart
+#define QUEUE_CACHE_LINE 64
+
+// DECLARE_QUEUE for one producer thread and one consumer thread.
+// Each side caches the other side's index and only reloads it (acquire)
+// when the ring looks full or empty.
+// Methods as DECLARE_QUEUE, and:
+//    Push<type>(value) - false when full
+//    PushBatch<type>(values, count) - pushes a prefix, returns its length
+//    PopBatch<type>(out, max) - pops up to max, returns the count
+#define DECLARE_SPSC_QUEUE(type, max_count)                                  \
+                                                                             \
+  static_assert((max_count & (max_count - 1)) == 0,                          \
+                "max_count must be a power of 2");                           \
+  constexpr uint64_t kMax##type = max_count;                                 \
+                                                                             \
+  static type k##type[max_count];                                            \
+                                                                             \
+  /* Each side's index and its last seen index of the other side share a */  \
+  /* line, the struct's alignment and size keep other data off both */       \
+  struct type##Cursor {                                                      \
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint64_t> read;                    \
+    uint64_t write_cache;                                                    \
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint64_t> write;                   \
+    uint64_t read_cache;                                                     \
+  };                                                                         \
+  static type##Cursor k##type##Cursor;                                       \
+                                                                             \
+  uint64_t PushBatch##type(const type* val, uint64_t count)                  \
+  {                                                                          \
+    type##Cursor* c = &k##type##Cursor;                                      \
+    uint64_t write = c->write.load(std::memory_order_relaxed);               \
+    uint64_t space = kMax##type - (write - c->read_cache);                   \
+    if (space < count) {                                                     \
+      c->read_cache = c->read.load(std::memory_order_acquire);               \
+      space = kMax##type - (write - c->read_cache);                          \
+    }                                                                        \
+    if (count > space) count = space;                                        \
+    for (uint64_t i = 0; i < count; ++i) {                                   \
+      k##type[(write + i) % kMax##type] = val[i];                            \
+    }                                                                        \
+    if (count) c->write.store(write + count, std::memory_order_release);     \
+    return count;                                                            \
+  }                                                                          \
+                                                                             \
+  uint64_t PopBatch##type(type* out, uint64_t max)                           \
+  {                                                                          \
+    type##Cursor* c = &k##type##Cursor;                                      \
+    uint64_t read = c->read.load(std::memory_order_relaxed);                 \
+    uint64_t avail = c->write_cache - read;                                  \
+    if (avail < max) {                                                       \
+      c->write_cache = c->write.load(std::memory_order_acquire);             \
+      avail = c->write_cache - read;                                         \
+    }                                                                        \
+    if (max > avail) max = avail;                                            \
+    for (uint64_t i = 0; i < max; ++i) {                                     \
+      out[i] = k##type[(read + i) % kMax##type];                             \
+    }                                                                        \
+    if (max) c->read.store(read + max, std::memory_order_release);           \
+    return max;                                                              \
+  }                                                                          \
+                                                                             \
+  type Pop##type()                                                           \
+  {                                                                          \
+    type ret{};                                                              \
+    PopBatch##type(&ret, 1);                                                 \
+    return ret;                                                              \
+  }                                                                          \
+                                                                             \
+  bool Push##type(type val)                                                  \
+  {                                                                          \
+    return PushBatch##type(&val, 1);                                         \
+  }                                                                          \
+                                                                             \
+  uint64_t Count##type()                                                     \
+  {                                                                          \
+    type##Cursor* c = &k##type##Cursor;                                      \
+    return c->write.load(std::memory_order_acquire) -                        \
+           c->read.load(std::memory_order_acquire);                          \
+  }
+
+// Bounded queue for any number of producer and consumer threads.
+// Each cell carries a turn counter, relative to its index so that zeroed
+// storage is ready for the first lap:
+//    turn == lap * kMax - the cell is free for the writer of that lap
+//    turn == lap * kMax + 1 - the cell holds the value of that lap
+// Threads claim a position by CAS on the write/read cursor, then publish the
+// cell with a release store of its turn.
+// Methods as DECLARE_QUEUE, and:
+//    Push<type>(value) - false when full
+//    TryPop<type>(out) - false when empty
+// There is no batch API: a claimed range would have to wait on every cell
+// still held by a slower thread of the previous lap.
+#define DECLARE_MPMC_QUEUE(type, max_count)                                  \
+                                                                             \
+  static_assert((max_count & (max_count - 1)) == 0,                          \
+                "max_count must be a power of 2");                           \
+  constexpr uint64_t kMax##type = max_count;                                 \
+                                                                             \
+  struct type##Cell {                                                        \
+    std::atomic<uint64_t> turn;                                              \
+    type value;                                                              \
+  };                                                                         \
+  static type##Cell k##type[max_count];                                      \
+                                                                             \
+  /* The struct's alignment and size give each index a line of its own */    \
+  struct type##Cursor {                                                      \
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint64_t> read;                    \
+    alignas(QUEUE_CACHE_LINE) std::atomic<uint64_t> write;                   \
+  };                                                                         \
+  static type##Cursor k##type##Cursor;                                       \
+                                                                             \
+  bool Push##type(type val)                                                  \
+  {                                                                          \
+    std::atomic<uint64_t>* cursor = &k##type##Cursor.write;                  \
+    uint64_t write = cursor->load(std::memory_order_relaxed);                \
+    type##Cell* cell;                                                        \
+    for (;;) {                                                               \
+      uint64_t index = write % kMax##type;                                   \
+      cell = &k##type[index];                                                \
+      uint64_t turn = cell->turn.load(std::memory_order_acquire);            \
+      int64_t diff = (int64_t)(turn + index - write);                        \
+      if (diff == 0) {                                                       \
+        if (cursor->compare_exchange_weak(write, write + 1,                  \
+                                          std::memory_order_relaxed)) {      \
+          break;                                                             \
+        }                                                                    \
+      } else if (diff < 0) {                                                 \
+        return false;                                                        \
+      } else {                                                               \
+        write = cursor->load(std::memory_order_relaxed);                     \
+      }                                                                      \
+    }                                                                        \
+    cell->value = val;                                                       \
+    cell->turn.store(write - write % kMax##type + 1,                         \
+                     std::memory_order_release);                             \
+    return true;                                                             \
+  }                                                                          \
+                                                                             \
+  bool TryPop##type(type* out)                                               \
+  {                                                                          \
+    std::atomic<uint64_t>* cursor = &k##type##Cursor.read;                   \
+    uint64_t read = cursor->load(std::memory_order_relaxed);                 \
+    type##Cell* cell;                                                        \
+    for (;;) {                                                               \
+      uint64_t index = read % kMax##type;                                    \
+      cell = &k##type[index];                                                \
+      uint64_t turn = cell->turn.load(std::memory_order_acquire);            \
+      int64_t diff = (int64_t)(turn + index - (read + 1));                   \
+      if (diff == 0) {                                                       \
+        if (cursor->compare_exchange_weak(read, read + 1,                    \
+                                          std::memory_order_relaxed)) {      \
+          break;                                                             \
+        }                                                                    \
+      } else if (diff < 0) {                                                 \
+        return false;                                                        \
+      } else {                                                               \
+        read = cursor->load(std::memory_order_relaxed);                      \
+      }                                                                      \
+    }                                                                        \
+    *out = cell->value;                                                      \
+    cell->turn.store(read - read % kMax##type + kMax##type,                  \
+                     std::memory_order_release);                             \
+    return true;                                                             \
+  }                                                                          \
+                                                                             \
+  type Pop##type()                                                           \
+  {                                                                          \
+    type ret{};                                                              \
+    TryPop##type(&ret);                                                      \
+    return ret;                                                              \
+  }                                                                          \
+                                                                             \
+  /* Approximate while other threads are active */                           \
+  uint64_t Count##type()                                                     \
+  {                                                                          \
+    type##Cursor* c = &k##type##Cursor;                                      \
+    uint64_t read = c->read.load(std::memory_order_acquire);                 \
+    uint64_t write = c->write.load(std::memory_order_acquire);               \
+    return write > read ? write - read : 0;                                  \
+  }
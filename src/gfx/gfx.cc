@@ -1,20 +1,31 @@
 #include "gfx.h"
 
+#include "common/profile.cc"
 #include "renderer/renderer.cc"
 
 #include "../simulation/simulation.cc"
 
 namespace gfx
 {
-constexpr int kMaxTextSize = 128;
 constexpr int kMaxTextCount = 32;
 
 struct Text {
-  char msg[kMaxTextSize];
+  // Copy in kFrameArena
+  const char* msg;
   float screen_x;
   float screen_y;
 };
 
+// Command depth, layers draw in this order
+enum Layer : uint8_t {
+  kLayerText,
+  kLayerUnit,
+  // Asteroids and pods, over the tiles they cross
+  kLayerTag,
+  kLayerWorld,
+  kLayerGrid,
+};
+
 struct Gfx {
   // Allow 32 on screen text messages.
   Text text[kMaxTextCount];
@@ -22,6 +33,9 @@ struct Gfx {
   rgg::Tag asteroid_tag;
   rgg::Tag pod_tag;
   math::AxisAlignedRect asteroid_aabb;
+  rgg::RenderCommandBuffer command;
+  // ExecuteGL once Initialize created the window
+  rgg::RenderBackend backend = rgg::ExecuteNull;
 };
 
 static Gfx kGfx;
@@ -68,6 +82,7 @@ Initialize()
   }
   kGfx.asteroid_tag = rgg::CreateRenderable(kVertCount, asteroid, GL_LINE_LOOP);
   kGfx.pod_tag = rgg::CreateRenderable(kPodVert, pod, GL_LINE_LOOP);
+  kGfx.backend = rgg::ExecuteGL;
   return status;
 }
 
@@ -87,13 +102,17 @@ Reset()
   kGfx.text_count = 0;
 }
 
+// Records the frame into buffer without GL calls
 void
-Render(const math::Rectf visible_world)
+Record(const math::Rectf visible_world, rgg::RenderCommandBuffer* buffer)
 {
+  rgg::ResetCommands(buffer);
+
   // Draw all text.
   for (int i = 0; i < kGfx.text_count; ++i) {
     Text& text = kGfx.text[i];
-    rgg::RenderText(text.msg, text.screen_x, text.screen_y, math::Vec4f());
+    rgg::CommandText(buffer, kLayerText, text.msg, text.screen_x,
+                     text.screen_y, math::Vec4f());
   }
 
   using namespace tilemap;
@@ -122,8 +141,9 @@ Render(const math::Rectf visible_world)
         break;
     }
     // Draw the player.
-    rgg::RenderRectangle(unit->transform.position, unit->transform.scale,
-                         unit->transform.orientation, color);
+    rgg::CommandRectangle(buffer, kLayerUnit, unit->transform.position,
+                          unit->transform.scale, unit->transform.orientation,
+                          color);
 
     math::Vec4f hilite;
     switch (unit->kind) {
@@ -135,9 +155,9 @@ Render(const math::Rectf visible_world)
         break;
     };
     // Highlight the tile the player is on.
-    rgg::RenderRectangle(math::Vec3f(grid),
-                         math::Vec3f(1.f / 2.f, 1.f / 2.f, 1.f),
-                         math::Quatf(0.f, 0.f, 0.f, 1.f), hilite);
+    rgg::CommandRectangle(buffer, kLayerUnit, math::Vec3f(grid),
+                          math::Vec3f(1.f / 2.f, 1.f / 2.f, 1.f),
+                          math::Quatf(0.f, 0.f, 0.f, 1.f), hilite);
 
     if (unit->command.type == Command::kNone) continue;
 
@@ -152,30 +172,33 @@ Render(const math::Rectf visible_world)
 
     for (int i = 0; i < path->size; ++i) {
       auto* t = &path->tile[i];
-      rgg::RenderRectangle(math::Vec3f(TilePosToWorld(*t)),
-                           math::Vec3f(1.f / 3.f, 1.f / 3.f, 1.f),
-                           math::Quatf(0.f, 0.f, 0.f, 1.f),
-                           math::Vec4f(0.33f, 0.33f, 0.66f, 0.7f));
+      rgg::CommandRectangle(buffer, kLayerUnit,
+                            math::Vec3f(TilePosToWorld(*t)),
+                            math::Vec3f(1.f / 3.f, 1.f / 3.f, 1.f),
+                            math::Quatf(0.f, 0.f, 0.f, 1.f),
+                            math::Vec4f(0.33f, 0.33f, 0.66f, 0.7f));
     }
   }
 
   for (int i = 0; i < kUsedAsteroid; ++i) {
     Asteroid* asteroid = &kAsteroid[i];
-    rgg::RenderTag(kGfx.asteroid_tag, asteroid->transform.position,
-                   asteroid->transform.scale, asteroid->transform.orientation,
-                   math::Vec4f(1.f, 1.f, 1.f, 1.f));
+    rgg::CommandTag(buffer, kLayerTag, kGfx.asteroid_tag,
+                    asteroid->transform.position, asteroid->transform.scale,
+                    asteroid->transform.orientation,
+                    math::Vec4f(1.f, 1.f, 1.f, 1.f));
   }
 
   for (int i = 0; i < kUsedPod; ++i) {
     Pod* pod = &kPod[i];
-    rgg::RenderTag(kGfx.pod_tag, pod->transform.position, pod->transform.scale,
-                   pod->transform.orientation, math::Vec4f(1.f, 1.f, 1.f, 1.f));
+    rgg::CommandTag(buffer, kLayerTag, kGfx.pod_tag, pod->transform.position,
+                    pod->transform.scale, pod->transform.orientation,
+                    math::Vec4f(1.f, 1.f, 1.f, 1.f));
   }
 
   for (int i = 0; i < kMapHeight; ++i) {
     for (int j = 0; j < kMapWidth; ++j) {
-      Tile* tile = &kTilemap.map[i][j];
-      uint64_t type_id = tile->type;
+      math::Vec2i tile(j, i);
+      uint64_t type_id = TileTypeSafe(tile);
 
       if (type_id == kTileOpen) continue;
 
@@ -194,21 +217,32 @@ Render(const math::Rectf visible_world)
           color = math::Vec4f(0.0, 0.75f, 0.0f, 1.0f);
       };
 
-      rgg::RenderRectangle(math::Vec3f(TileToWorld(*tile)),
-                           math::Vec3f(1.f / 2.f, 1.f / 2.f, 1.f),
-                           math::Quatf(0.f, 0.f, 0.f, 1.f), color);
+      rgg::CommandRectangle(buffer, kLayerWorld,
+                            math::Vec3f(TilePosToWorld(tile)),
+                            math::Vec3f(1.f / 2.f, 1.f / 2.f, 1.f),
+                            math::Quatf(0.f, 0.f, 0.f, 1.f), color);
     }
   }
 
   const math::Vec2f grid2(50.f, 50.f);
   math::Rectf world2 = visible_world;
   AlignToGrid(grid2, &world2);
-  rgg::RenderGrid(grid2, world2, math::Vec4f(0.207f, 0.317f, 0.360f, 0.60f));
+  rgg::CommandGrid(buffer, kLayerGrid, grid2, world2,
+                   math::Vec4f(0.207f, 0.317f, 0.360f, 0.60f));
 
   const math::Vec2f grid1(25.f, 25.f);
   math::Rectf world1 = visible_world;
   AlignToGrid(grid1, &world1);
-  rgg::RenderGrid(grid1, world1, math::Vec4f(0.050f, 0.215f, 0.050f, 0.45f));
+  rgg::CommandGrid(buffer, kLayerGrid, grid1, world1,
+                   math::Vec4f(0.050f, 0.215f, 0.050f, 0.45f));
+}
+
+void
+Render(const math::Rectf visible_world)
+{
+  Record(visible_world, &kGfx.command);
+  rgg::SortCommands(&kGfx.command);
+  kGfx.backend(&kGfx.command);
 }
 
 void
@@ -216,12 +250,40 @@ PushText(const char* msg, float screen_x, float screen_y)
 {
   assert(kGfx.text_count + 1 < kMaxTextCount);
   if (kGfx.text_count + 1 >= kMaxTextCount) return;
-  int len = strlen(msg);
-  if (len > kMaxTextSize) return;
+  const char* copy = ArenaPushString(&kFrameArena, msg, strlen(msg));
+  if (!copy) return;
   Text& text = kGfx.text[kGfx.text_count++];
-  strcpy(text.msg, msg);
+  text.msg = copy;
   text.screen_x = screen_x;
   text.screen_y = screen_y;
 }
 
+// Profile zones of the main thread in frame, one line per zone indented by
+// depth with a bar of its share of the frame, starting at screen_y downward
+void
+PushProfile(const Clock_t* clock, uint32_t frame, float screen_x,
+            float screen_y)
+{
+  constexpr int kMaxLines = 12;
+  constexpr int kBarWidth = 20;
+  ProfileZone zone[kMaxLines];
+  uint64_t count = ProfileFrameZones(0, frame, zone, kMaxLines);
+
+  uint64_t frame_tsc = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (zone[i].depth == 0) frame_tsc += zone[i].end_tsc - zone[i].begin_tsc;
+  }
+  if (!frame_tsc) return;
+
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t tsc = zone[i].end_tsc - zone[i].begin_tsc;
+    int bar = (int)(tsc * kBarWidth / frame_tsc);
+    char line[128];
+    snprintf(line, sizeof(line), "%*s%-12s %6lu us %.*s", zone[i].depth * 2,
+             "", zone[i].name, platform::tscdelta_to_usec(clock, tsc), bar,
+             "####################");
+    PushText(line, screen_x, screen_y - 25.f * i);
+  }
+}
+
 }  // namespace gfx
@@ -4,22 +4,30 @@
 
 #include "server.cc"
 
-// Input events capable of being processed in one game loop
-#define MAX_TICK_EVENTS 32
 // Game loop inputs allowed in-flight on the network
 #define MAX_NETQUEUE 128
 // Convert frame id into a NETQUEUE slot
-#define NETQUEUE_SLOT(sequence) (sequence % MAX_NETQUEUE)
-// Players in one game
-#define MAX_PLAYER 2
+#define NETQUEUE_SLOT(sequence) ((sequence) % MAX_NETQUEUE)
+// Bounds on game loops between capturing input and simulating it
+#define MIN_INPUT_DELAY 2
+#define MAX_INPUT_DELAY (MAX_NETQUEUE / 2)
+// Logic frames between state hash exchanges
+#define HASH_INTERVAL 32
+// Local hashes kept for comparison, covers input in-flight on the network
+#define MAX_HASH_HISTORY (MAX_NETQUEUE / HASH_INTERVAL + 1)
 // System memory block: Move to platform?
 #define PAGE (4 * 1024)
 
 struct InputBuffer {
   PlatformEvent input_event[MAX_TICK_EVENTS];
   uint64_t used_input_event = 0;
+  // State hash of the sender, see HASH_INTERVAL
+  FrameHash state_hash;
 };
 
+static_assert(kMaxFrameBits / 8 + 1 + sizeof(Turn) <= MAX_DATAGRAM,
+              "A full InputBuffer must fit in one Turn datagram");
+
 struct NetworkState {
   // Events handled per input game frame for NETQUEUE frames
   // History is preserved until network acknowledgement
@@ -39,6 +47,17 @@ struct NetworkState {
   InputBuffer player_input[MAX_NETQUEUE][MAX_PLAYER];
   bool player_received[MAX_NETQUEUE][MAX_PLAYER];
   uint64_t outgoing_ack[MAX_PLAYER];
+  // Local time each sequence was captured
+  uint64_t send_tsc[MAX_NETQUEUE];
+  // Smoothed round trip and its mean deviation (RFC 6298)
+  uint64_t srtt_usec;
+  uint64_t rttvar_usec;
+  // Target game loops between capturing input and simulating it
+  uint64_t input_delay = MIN_INPUT_DELAY;
+  Clock_t clock;
+  // Local state hashes, and the next one to send
+  FrameHash hash_history[MAX_HASH_HISTORY];
+  FrameHash pending_hash;
 };
 
 static NetworkState kNetworkState;
@@ -98,30 +117,46 @@ NetworkSetup()
 
   kNetworkState.player_id = ns->player_id;
   kNetworkState.player_count = ns->player_count;
+  kNetworkState.clock = handshake_clock;
 
   return true;
 }
 
+// Frames of local input to capture this game loop
+// Steers the input delay toward input_delay by one frame per loop, so
+// jitter grows the queue smoothly instead of stalling the simulation
+uint64_t
+InputFrameCount(uint64_t logic_frame)
+{
+  uint64_t delay = kNetworkState.outgoing_sequence - logic_frame;
+  uint64_t unacked = kNetworkState.outgoing_sequence -
+                     kNetworkState.outgoing_ack[kNetworkState.player_id];
+  uint64_t count = 1;
+  if (delay > kNetworkState.input_delay) count = 0;
+  if (delay < kNetworkState.input_delay) count = 2;
+
+  // Hold input rather than overrun unacknowledged history
+  uint64_t room = unacked < MAX_NETQUEUE - 1 ? MAX_NETQUEUE - 1 - unacked : 0;
+  return MIN(count, room);
+}
+
 InputBuffer*
 GetNextInputBuffer()
 {
   uint64_t slot = NETQUEUE_SLOT(kNetworkState.outgoing_sequence);
-  uint64_t event_count = 0;
 
 #if 0
   printf("ProcessInput [ %lu seq ][ %lu slot ]\n", kNetworkState.outgoing_sequence,
          slot);
 #endif
 
-  // If unacknowledged packets exceed the queue, give up
-  if (kNetworkState.outgoing_sequence -
-          kNetworkState.outgoing_ack[kNetworkState.player_id] >=
-      MAX_NETQUEUE)
-    exit(2);
-
+  kNetworkState.send_tsc[slot] = rdtsc();
   kNetworkState.outgoing_sequence += 1;
 
-  return &kNetworkState.input[slot];
+  InputBuffer* ibuf = &kNetworkState.input[slot];
+  ibuf->state_hash = kNetworkState.pending_hash;
+  kNetworkState.pending_hash = FrameHash{};
+  return ibuf;
 }
 
 InputBuffer*
@@ -133,40 +168,60 @@ GetSlot(uint64_t slot)
   return kNetworkState.player_input[slot];
 }
 
-bool
-SlotReady(uint64_t slot)
+// Record the local state hash after frame, every HASH_INTERVAL frames
+// it rides along with the next captured input
+void
+NetworkStateHash(uint64_t frame, uint64_t hash)
 {
-  for (int i = 0; i < kNetworkState.player_count; ++i) {
-    if (!kNetworkState.player_received[slot][i]) return false;
-  }
+  if (frame % HASH_INTERVAL) return;
+  FrameHash fh = {frame, hash};
+  kNetworkState.hash_history[(frame / HASH_INTERVAL) % MAX_HASH_HISTORY] = fh;
+  kNetworkState.pending_hash = fh;
+}
 
-  return true;
+// False when a player's state hash differs from the local one
+// Hashes older than the local history are not checked
+bool
+NetworkHashMatch(const FrameHash& remote)
+{
+  if (!remote.frame) return true;
+  const FrameHash& local =
+      kNetworkState
+          .hash_history[(remote.frame / HASH_INTERVAL) % MAX_HASH_HISTORY];
+  if (local.frame != remote.frame) return true;
+  return local.hash == remote.hash;
 }
 
+// Input delay covering the round trip plus four deviations of jitter
 void
-NetworkSend(uint64_t seq)
+NetworkRttSample(uint64_t rtt_usec, uint64_t frame_usec)
 {
-  uint64_t slot = NETQUEUE_SLOT(seq);
-  InputBuffer* ibuf = &kNetworkState.input[slot];
-
-  // write frame
-  Turn* header = (Turn*)kNetworkState.netbuffer;
-  header->sequence = seq;
-  header->player_id = kNetworkState.player_id;
-#if 0
-  printf("CliSnd [ %lu seq ] [ %lu slot ] [ %lu player_id ] [ %lu events ]\n",
-         seq, slot, kNetworkState.player_id, ibuf->used_input_event);
-#endif
+  uint64_t srtt = kNetworkState.srtt_usec;
+  uint64_t rttvar = kNetworkState.rttvar_usec;
+  if (!srtt) {
+    srtt = rtt_usec;
+    rttvar = rtt_usec / 2;
+  } else {
+    uint64_t err = rtt_usec > srtt ? rtt_usec - srtt : srtt - rtt_usec;
+    rttvar = (3 * rttvar + err) / 4;
+    srtt = (7 * srtt + rtt_usec) / 8;
+  }
+  kNetworkState.srtt_usec = MAX(srtt, 1);
+  kNetworkState.rttvar_usec = rttvar;
 
-  // write input
-  memcpy(header->event, ibuf->input_event,
-         sizeof(PlatformEvent) * ibuf->used_input_event);
+  uint64_t delay = (srtt + 4 * rttvar + frame_usec - 1) / frame_usec;
+  kNetworkState.input_delay =
+      CLAMP(delay, (uint64_t)MIN_INPUT_DELAY, (uint64_t)MAX_INPUT_DELAY);
+}
 
-  if (!udp::Send(
-          kNetworkState.socket, kNetworkState.netbuffer,
-          sizeof(Turn) + sizeof(PlatformEvent) * ibuf->used_input_event)) {
-    exit(1);
+bool
+SlotReady(uint64_t slot)
+{
+  for (int i = 0; i < kNetworkState.player_count; ++i) {
+    if (!kNetworkState.player_received[slot][i]) return false;
   }
+
+  return true;
 }
 
 void
@@ -174,50 +229,91 @@ NetworkEgress()
 {
   uint64_t begin_seq = kNetworkState.outgoing_ack[kNetworkState.player_id] + 1;
   uint64_t end_seq = kNetworkState.outgoing_sequence;
+  if (begin_seq >= end_seq) return;
 
-  // Re-send input history
+  // Re-send input history in one datagram, oldest first
+  Turn turn = {begin_seq, kNetworkState.player_id, 0};
+  uint64_t frame_bits = 0;
   for (uint64_t i = begin_seq; i < end_seq; ++i) {
-    NetworkSend(i);
+    InputBuffer* ibuf = &kNetworkState.input[NETQUEUE_SLOT(i)];
+    uint64_t bits = FrameBits(ibuf->input_event, ibuf->used_input_event,
+                              ibuf->state_hash);
+    Turn next = turn;
+    next.frame_count += 1;
+    if (TurnHeaderBits(next) + frame_bits + bits > MAX_DATAGRAM * 8) break;
+    turn = next;
+    frame_bits += bits;
+  }
+
+  BitStream s;
+  BitStreamInit(kNetworkState.netbuffer, MAX_DATAGRAM, &s);
+  EncodeTurn(&s, turn);
+  for (uint64_t i = 0; i < turn.frame_count; ++i) {
+    InputBuffer* ibuf = &kNetworkState.input[NETQUEUE_SLOT(begin_seq + i)];
+#if 0
+    printf("CliSnd [ %lu seq ] [ %lu player_id ] [ %lu events ]\n",
+           begin_seq + i, kNetworkState.player_id, ibuf->used_input_event);
+#endif
+    EncodeFrame(&s, ibuf->input_event, ibuf->used_input_event,
+                ibuf->state_hash);
+  }
+
+  if (!udp::Send(kNetworkState.socket, kNetworkState.netbuffer,
+                 BitStreamBytes(&s))) {
+    exit(1);
   }
 }
 
 void
-NetworkIngress(uint64_t current_frame)
+NetworkIngress(uint64_t current_frame, uint64_t frame_usec)
 {
   uint64_t local_player = kNetworkState.player_id;
 
   int16_t bytes_received;
   while (udp::ReceiveFrom(kNetworkState.socket, sizeof(kNetworkState.netbuffer),
                           kNetworkState.netbuffer, &bytes_received)) {
-    NotifyTurn* header = (NotifyTurn*)kNetworkState.netbuffer;
-    uint64_t frame = header->frame;
-    uint64_t player_id = header->player_id;
+    BitStream s;
+    BitStreamInit(kNetworkState.netbuffer, bytes_received, &s);
+    NotifyTurn header;
+    PlatformEvent event[MAX_TICK_EVENTS];
+    uint64_t event_count;
+    FrameHash state_hash;
+    if (!DecodeNotifyTurn(&s, &header, event, MAX_TICK_EVENTS, &event_count,
+                          &state_hash))
+      exit(3);
+    uint64_t frame = header.frame;
+    uint64_t player_id = header.player_id;
 #if 0
     printf("CliRcv [ %lu frame ] [ %lu player_id ] [ %lu ack_seq ]\n", frame,
-           player_id, header->ack_sequence);
+           player_id, header.ack_sequence);
 #endif
 
     // Drop old frames, the game has progressed
     if (frame < current_frame) continue;
     // Personal boundaries
     if (player_id >= MAX_PLAYER) exit(1);
-    if (bytes_received > sizeof(NotifyTurn) + sizeof(InputBuffer::input_event))
-      exit(3);
 
     uint64_t slot = NETQUEUE_SLOT(frame);
     InputBuffer* ibuf = &kNetworkState.player_input[slot][player_id];
-    memcpy(ibuf->input_event, header->event,
-           bytes_received - sizeof(NotifyTurn));
-    ibuf->used_input_event =
-        (bytes_received - sizeof(NotifyTurn)) / sizeof(PlatformEvent);
-#if 0
-    printf("Copied %lu, used_input_event %lu\n", bytes_received - header_size,
-           ibuf->used_input_event);
-#endif
+    memcpy(ibuf->input_event, event, event_count * sizeof(PlatformEvent));
+    ibuf->used_input_event = event_count;
+    ibuf->state_hash = state_hash;
     kNetworkState.player_received[slot][player_id] = true;
+    // Time the echo of newly acknowledged local input. Only the echo that
+    // advances the ack is sampled: a duplicate echo cannot be told apart
+    // from the echo of a resend (Karn's algorithm), and when an echo is
+    // lost the next one samples the newest sequence it acknowledges.
+    if (player_id == local_player &&
+        header.ack_sequence > kNetworkState.outgoing_ack[player_id] &&
+        header.ack_sequence < kNetworkState.outgoing_sequence) {
+      uint64_t slot = NETQUEUE_SLOT(header.ack_sequence);
+      uint64_t rtt_usec = platform::tscdelta_to_usec(
+          &kNetworkState.clock, rdtsc() - kNetworkState.send_tsc[slot]);
+      NetworkRttSample(rtt_usec, frame_usec);
+    }
     // Accept highest received ack_sequence
     kNetworkState.outgoing_ack[player_id] =
-        MAX(kNetworkState.outgoing_ack[player_id], header->ack_sequence);
+        MAX(kNetworkState.outgoing_ack[player_id], header.ack_sequence);
   }
 }
 
@@ -0,0 +1,76 @@
+#include <cassert>
+#include <cstdio>
+
+#include "network.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+// Frames kept in flight before the ack catches up
+constexpr uint64_t kAckLag = 5;
+
+static Udp4 kLocation;
+static uint8_t kDatagram[MAX_DATAGRAM];
+
+// Captures a frame holding one key event naming its sequence
+void
+Capture()
+{
+  uint64_t sequence = kNetworkState.outgoing_sequence;
+  InputBuffer* ibuf = GetNextInputBuffer();
+  PlatformEvent event = {};
+  event.type = KEY_DOWN;
+  event.key = 'a' + sequence % 26;
+  ibuf->input_event[0] = event;
+  ibuf->used_input_event = 1;
+}
+
+// The Turn sent by NetworkEgress holds every unacknowledged frame in order
+void
+ExpectTurn()
+{
+  uint16_t bytes;
+  Udp4 from;
+  ASSERT_TRUE(udp::ReceiveAny(kLocation, MAX_DATAGRAM, kDatagram, &bytes,
+                              &from));
+  BitStream s;
+  BitStreamInit(kDatagram, bytes, &s);
+  Turn turn;
+  ASSERT_TRUE(DecodeTurn(&s, &turn));
+  ASSERT_TRUE(turn.sequence == kNetworkState.outgoing_ack[0] + 1);
+  ASSERT_TRUE(turn.sequence + turn.frame_count ==
+              kNetworkState.outgoing_sequence);
+  for (uint64_t i = 0; i < turn.frame_count; ++i) {
+    PlatformEvent event[MAX_TICK_EVENTS];
+    uint64_t count;
+    FrameHash hash;
+    ASSERT_TRUE(DecodeFrame(&s, event, MAX_TICK_EVENTS, &count, &hash));
+    ASSERT_TRUE(count == 1);
+    ASSERT_TRUE(event[0].key == (char)('a' + (turn.sequence + i) % 26));
+  }
+}
+
+// Resends walk the history ring across its wrap
+void
+EgressWraps()
+{
+  for (uint64_t i = 0; i < 3 * MAX_NETQUEUE; ++i) {
+    Capture();
+    NetworkEgress();
+    ExpectTurn();
+    uint64_t sent = kNetworkState.outgoing_sequence - 1;
+    if (sent > kAckLag) kNetworkState.outgoing_ack[0] = sent - kAckLag;
+  }
+  ASSERT_TRUE(kNetworkState.outgoing_sequence > 3 * MAX_NETQUEUE);
+}
+
+int
+main()
+{
+  ASSERT_TRUE(udp::Init());
+  ASSERT_TRUE(udp::GetAddr4("127.0.0.1", "9846", &kLocation));
+  ASSERT_TRUE(udp::Bind(kLocation));
+  ASSERT_TRUE(udp::GetAddr4("127.0.0.1", "9846", &kNetworkState.socket));
+  EgressWraps();
+  printf("network ok\n");
+  return 0;
+}
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 
 #include "platform/platform.cc"
 
+// Players in one game
+#define MAX_PLAYER 2
+// Datagram budget that stays below common path MTUs
+#define MAX_DATAGRAM 1200
+// Input events capable of being processed in one game loop
+#define MAX_TICK_EVENTS 32
+
 const uint64_t greeting_size = 8;
 #define GREETING "spacehi"
 
@@ -18,15 +26,309 @@ struct NotifyStart {
   uint64_t player_count;
 };
 
+// Unacknowledged input for sequences [sequence, sequence + frame_count)
+// Followed by frame_count encoded frames, oldest first
 struct Turn {
   uint64_t sequence;
   uint64_t player_id;
-  PlatformEvent event[];
+  uint64_t frame_count;
 };
 
+// Input of one player for one game frame
+// Followed by one encoded frame
 struct NotifyTurn {
   uint64_t frame;
   uint64_t player_id;
   uint64_t ack_sequence;
-  PlatformEvent event[];
 };
+
+// Simulation state hash after frame, 0 frame when not present
+struct FrameHash {
+  uint64_t frame;
+  uint64_t hash;
+};
+
+// Wire format of Turn and NotifyTurn, bumped on any layout change
+constexpr uint64_t kProtocolVersion = 2;
+
+constexpr int
+BitWidth(uint64_t value)
+{
+  return value ? 1 + BitWidth(value >> 1) : 0;
+}
+
+constexpr int kVersionBits = 8;
+constexpr int kPlayerBits = BitWidth(MAX_PLAYER - 1);
+constexpr int kEventTypeBits = 3;
+constexpr int kButtonBits = 2;
+constexpr int kKeyBits = 8;
+// Mouse positions are whole screen pixels in [0, 8192)
+constexpr int kPositionBits = 13;
+// Varints are groups of 3 value bits and 1 continuation bit
+constexpr int kVarintGroupBits = 3;
+
+static_assert(KEY_UP < (1 << kEventTypeBits), "PlatformEventType overflow");
+static_assert(BUTTON_RIGHT < (1 << kButtonBits), "PlatformButton overflow");
+
+// Little-endian bit cursor over a byte buffer
+// Reads and writes past the end set error instead of touching memory
+struct BitStream {
+  uint8_t* buffer;
+  uint64_t bytes;
+  uint64_t bit;
+  bool error;
+};
+
+void
+BitStreamInit(void* buffer, uint64_t bytes, BitStream* s)
+{
+  s->buffer = (uint8_t*)buffer;
+  s->bytes = bytes;
+  s->bit = 0;
+  s->error = false;
+}
+
+// Bytes touched by the stream so far
+uint64_t
+BitStreamBytes(const BitStream* s)
+{
+  return (s->bit + 7) / 8;
+}
+
+void
+WriteBits(BitStream* s, uint64_t value, int count)
+{
+  if (s->bit + count > s->bytes * 8) {
+    s->error = true;
+    return;
+  }
+
+  while (count) {
+    uint64_t byte = s->bit / 8;
+    int offset = s->bit % 8;
+    int n = std::min(8 - offset, count);
+    uint8_t mask = ((1u << n) - 1) << offset;
+    s->buffer[byte] = (s->buffer[byte] & ~mask) | ((value << offset) & mask);
+    value >>= n;
+    count -= n;
+    s->bit += n;
+  }
+}
+
+uint64_t
+ReadBits(BitStream* s, int count)
+{
+  if (s->bit + count > s->bytes * 8) {
+    s->error = true;
+    return 0;
+  }
+
+  uint64_t value = 0;
+  int shift = 0;
+  while (count) {
+    uint64_t byte = s->bit / 8;
+    int offset = s->bit % 8;
+    int n = std::min(8 - offset, count);
+    uint64_t bits = (s->buffer[byte] >> offset) & ((1u << n) - 1);
+    value |= bits << shift;
+    shift += n;
+    count -= n;
+    s->bit += n;
+  }
+
+  return value;
+}
+
+constexpr uint64_t
+VarintBits(uint64_t value)
+{
+  uint64_t groups = 1;
+  while (value >>= kVarintGroupBits) ++groups;
+  return groups * (kVarintGroupBits + 1);
+}
+
+void
+WriteVarint(BitStream* s, uint64_t value)
+{
+  const uint64_t group_mask = (1 << kVarintGroupBits) - 1;
+  while (value > group_mask) {
+    WriteBits(s, (value & group_mask) | (group_mask + 1), kVarintGroupBits + 1);
+    value >>= kVarintGroupBits;
+  }
+  WriteBits(s, value, kVarintGroupBits + 1);
+}
+
+uint64_t
+ReadVarint(BitStream* s)
+{
+  const uint64_t group_mask = (1 << kVarintGroupBits) - 1;
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += kVarintGroupBits) {
+    uint64_t group = ReadBits(s, kVarintGroupBits + 1);
+    value |= (group & group_mask) << shift;
+    if (!(group & (group_mask + 1))) return value;
+  }
+
+  s->error = true;
+  return 0;
+}
+
+uint64_t
+QuantizePosition(float p)
+{
+  const float max = (1 << kPositionBits) - 1;
+  // Negated compare also maps NaN to 0
+  if (!(p > 0.f)) return 0;
+  if (p >= max) return max;
+  return (uint64_t)(p + 0.5f);
+}
+
+// Only the fields read by the simulation are encoded:
+// mouse events keep position and button, key events keep the key
+uint64_t
+EventBits(const PlatformEvent& event)
+{
+  switch (event.type) {
+    case MOUSE_DOWN:
+    case MOUSE_UP:
+      return kEventTypeBits + 2 * kPositionBits + kButtonBits;
+    case KEY_DOWN:
+    case KEY_UP:
+      return kEventTypeBits + kKeyBits;
+    default:
+      return kEventTypeBits;
+  }
+}
+
+void
+WriteEvent(BitStream* s, const PlatformEvent& event)
+{
+  WriteBits(s, event.type, kEventTypeBits);
+  switch (event.type) {
+    case MOUSE_DOWN:
+    case MOUSE_UP:
+      WriteBits(s, QuantizePosition(event.position.x), kPositionBits);
+      WriteBits(s, QuantizePosition(event.position.y), kPositionBits);
+      WriteBits(s, event.button, kButtonBits);
+      break;
+    case KEY_DOWN:
+    case KEY_UP:
+      WriteBits(s, (uint8_t)event.key, kKeyBits);
+      break;
+    default:
+      break;
+  }
+}
+
+void
+ReadEvent(BitStream* s, PlatformEvent* event)
+{
+  *event = PlatformEvent{};
+  event->type = (PlatformEventType)ReadBits(s, kEventTypeBits);
+  switch (event->type) {
+    case MOUSE_DOWN:
+    case MOUSE_UP:
+      event->position.x = ReadBits(s, kPositionBits);
+      event->position.y = ReadBits(s, kPositionBits);
+      event->button = (PlatformButton)ReadBits(s, kButtonBits);
+      break;
+    case KEY_DOWN:
+    case KEY_UP:
+      event->key = (char)ReadBits(s, kKeyBits);
+      break;
+    default:
+      break;
+  }
+}
+
+// Largest encoded frame
+constexpr uint64_t kMaxFrameBits =
+    VarintBits(MAX_TICK_EVENTS) +
+    MAX_TICK_EVENTS * (kEventTypeBits + 2 * kPositionBits + kButtonBits) + 1 +
+    VarintBits(UINT64_MAX) + 64;
+
+uint64_t
+FrameBits(const PlatformEvent* event, uint64_t count, const FrameHash& hash)
+{
+  uint64_t bits = VarintBits(count) + 1;
+  for (uint64_t i = 0; i < count; ++i) bits += EventBits(event[i]);
+  if (hash.frame) bits += VarintBits(hash.frame) + 64;
+  return bits;
+}
+
+// Frame events, then a flag bit and the optional state hash
+void
+EncodeFrame(BitStream* s, const PlatformEvent* event, uint64_t count,
+            const FrameHash& hash)
+{
+  WriteVarint(s, count);
+  for (uint64_t i = 0; i < count; ++i) WriteEvent(s, event[i]);
+  WriteBits(s, hash.frame != 0, 1);
+  if (!hash.frame) return;
+  WriteVarint(s, hash.frame);
+  WriteBits(s, hash.hash, 64);
+}
+
+bool
+DecodeFrame(BitStream* s, PlatformEvent* event, uint64_t max_count,
+            uint64_t* count, FrameHash* hash)
+{
+  *count = ReadVarint(s);
+  if (*count > max_count) s->error = true;
+  for (uint64_t i = 0; i < *count && !s->error; ++i) ReadEvent(s, &event[i]);
+  *hash = FrameHash{};
+  if (ReadBits(s, 1)) {
+    hash->frame = ReadVarint(s);
+    hash->hash = ReadBits(s, 64);
+  }
+  return !s->error;
+}
+
+uint64_t
+TurnHeaderBits(const Turn& turn)
+{
+  return kVersionBits + kPlayerBits + VarintBits(turn.sequence) +
+         VarintBits(turn.frame_count);
+}
+
+void
+EncodeTurn(BitStream* s, const Turn& turn)
+{
+  WriteBits(s, kProtocolVersion, kVersionBits);
+  WriteBits(s, turn.player_id, kPlayerBits);
+  WriteVarint(s, turn.sequence);
+  WriteVarint(s, turn.frame_count);
+}
+
+bool
+DecodeTurn(BitStream* s, Turn* turn)
+{
+  if (ReadBits(s, kVersionBits) != kProtocolVersion) return false;
+  turn->player_id = ReadBits(s, kPlayerBits);
+  turn->sequence = ReadVarint(s);
+  turn->frame_count = ReadVarint(s);
+  return !s->error;
+}
+
+// The acknowledgement trails the frame, it is sent as a delta
+void
+EncodeNotifyTurn(BitStream* s, const NotifyTurn& nt, const PlatformEvent* event,
+                 uint64_t count, const FrameHash& hash)
+{
+  WriteBits(s, kProtocolVersion, kVersionBits);
+  WriteBits(s, nt.player_id, kPlayerBits);
+  WriteVarint(s, nt.frame);
+  WriteVarint(s, nt.frame - nt.ack_sequence);
+  EncodeFrame(s, event, count, hash);
+}
+
+bool
+DecodeNotifyTurn(BitStream* s, NotifyTurn* nt, PlatformEvent* event,
+                 uint64_t max_count, uint64_t* count, FrameHash* hash)
+{
+  if (ReadBits(s, kVersionBits) != kProtocolVersion) return false;
+  nt->player_id = ReadBits(s, kPlayerBits);
+  nt->frame = ReadVarint(s);
+  nt->ack_sequence = nt->frame - ReadVarint(s);
+  return DecodeFrame(s, event, max_count, count, hash);
+}
@@ -0,0 +1,261 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "protocol.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+PlatformEvent
+MouseEvent(PlatformEventType type, float x, float y, PlatformButton button)
+{
+  PlatformEvent event = {};
+  event.type = type;
+  event.position = math::Vec2f(x, y);
+  event.button = button;
+  return event;
+}
+
+PlatformEvent
+KeyEvent(PlatformEventType type, char key)
+{
+  PlatformEvent event = {};
+  event.type = type;
+  event.key = key;
+  return event;
+}
+
+bool
+EventEqual(const PlatformEvent& a, const PlatformEvent& b)
+{
+  return a.type == b.type && a.position.x == b.position.x &&
+         a.position.y == b.position.y && a.button == b.button &&
+         a.key == b.key;
+}
+
+void
+BitsRoundTrip()
+{
+  uint8_t buffer[64] = {};
+  BitStream s;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  WriteBits(&s, 1, 1);
+  WriteBits(&s, 0x5a, 7);
+  WriteBits(&s, 0x1fff, 13);
+  WriteBits(&s, 0xdeadbeefcafe, 48);
+  WriteBits(&s, ~0ull, 64);
+  ASSERT_TRUE(!s.error);
+  ASSERT_TRUE(BitStreamBytes(&s) == (1 + 7 + 13 + 48 + 64 + 7) / 8);
+
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  ASSERT_TRUE(ReadBits(&s, 1) == 1);
+  ASSERT_TRUE(ReadBits(&s, 7) == 0x5a);
+  ASSERT_TRUE(ReadBits(&s, 13) == 0x1fff);
+  ASSERT_TRUE(ReadBits(&s, 48) == 0xdeadbeefcafe);
+  ASSERT_TRUE(ReadBits(&s, 64) == ~0ull);
+  ASSERT_TRUE(!s.error);
+}
+
+void
+VarintRoundTrip()
+{
+  const uint64_t value[] = {0, 1, 7, 8, 63, 64, 1000, 1ull << 40, ~0ull};
+  uint8_t buffer[256] = {};
+  BitStream s;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  for (uint64_t v : value) WriteVarint(&s, v);
+  ASSERT_TRUE(!s.error);
+
+  uint64_t bits = 0;
+  for (uint64_t v : value) bits += VarintBits(v);
+  ASSERT_TRUE(s.bit == bits);
+  ASSERT_TRUE(VarintBits(0) == 4);
+  ASSERT_TRUE(VarintBits(7) == 4);
+  ASSERT_TRUE(VarintBits(8) == 8);
+
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  for (uint64_t v : value) ASSERT_TRUE(ReadVarint(&s) == v);
+  ASSERT_TRUE(!s.error);
+}
+
+void
+EventRoundTrip()
+{
+  const PlatformEvent event[] = {
+      MouseEvent(MOUSE_DOWN, 100.f, 200.f, BUTTON_LEFT),
+      MouseEvent(MOUSE_UP, 8191.f, 0.f, BUTTON_RIGHT),
+      KeyEvent(KEY_DOWN, 'w'),
+      KeyEvent(KEY_UP, 27),
+      PlatformEvent{},
+  };
+  const int count = sizeof(event) / sizeof(event[0]);
+  uint8_t buffer[64] = {};
+  BitStream s;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  EncodeFrame(&s, event, count, FrameHash{});
+  ASSERT_TRUE(!s.error);
+  ASSERT_TRUE(s.bit == FrameBits(event, count, FrameHash{}));
+
+  PlatformEvent decoded[count];
+  uint64_t decoded_count;
+  FrameHash hash;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  ASSERT_TRUE(DecodeFrame(&s, decoded, count, &decoded_count, &hash));
+  ASSERT_TRUE(decoded_count == count);
+  ASSERT_TRUE(hash.frame == 0);
+  for (int i = 0; i < count; ++i) ASSERT_TRUE(EventEqual(event[i], decoded[i]));
+
+  // Too many events for the receiver
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  ASSERT_TRUE(!DecodeFrame(&s, decoded, count - 1, &decoded_count, &hash));
+}
+
+void
+PositionQuantization()
+{
+  ASSERT_TRUE(QuantizePosition(-5.f) == 0);
+  ASSERT_TRUE(QuantizePosition(0.4f) == 0);
+  ASSERT_TRUE(QuantizePosition(0.6f) == 1);
+  ASSERT_TRUE(QuantizePosition(640.5f) == 641);
+  ASSERT_TRUE(QuantizePosition(1e9f) == 8191);
+  ASSERT_TRUE(QuantizePosition(NAN) == 0);
+}
+
+void
+TurnRoundTrip()
+{
+  PlatformEvent frame[3][2] = {
+      {KeyEvent(KEY_DOWN, 'a'), KeyEvent(KEY_UP, 'a')},
+      {},
+      {MouseEvent(MOUSE_DOWN, 33.f, 44.f, BUTTON_MIDDLE)},
+  };
+  const uint64_t frame_events[3] = {2, 0, 1};
+  Turn turn = {1234, MAX_PLAYER - 1, 3};
+
+  uint8_t buffer[MAX_DATAGRAM];
+  BitStream s;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  EncodeTurn(&s, turn);
+  ASSERT_TRUE(s.bit == TurnHeaderBits(turn));
+  const FrameHash frame_hash[3] = {{}, {96, 0xfedcba9876543210}, {}};
+  for (int i = 0; i < 3; ++i) {
+    EncodeFrame(&s, frame[i], frame_events[i], frame_hash[i]);
+  }
+  ASSERT_TRUE(!s.error);
+  uint64_t bytes = BitStreamBytes(&s);
+
+  Turn decoded;
+  BitStreamInit(buffer, bytes, &s);
+  ASSERT_TRUE(DecodeTurn(&s, &decoded));
+  ASSERT_TRUE(decoded.sequence == turn.sequence);
+  ASSERT_TRUE(decoded.player_id == turn.player_id);
+  ASSERT_TRUE(decoded.frame_count == turn.frame_count);
+  for (int i = 0; i < 3; ++i) {
+    PlatformEvent event[MAX_TICK_EVENTS];
+    uint64_t count;
+    FrameHash hash;
+    ASSERT_TRUE(DecodeFrame(&s, event, MAX_TICK_EVENTS, &count, &hash));
+    ASSERT_TRUE(count == frame_events[i]);
+    ASSERT_TRUE(hash.frame == frame_hash[i].frame);
+    ASSERT_TRUE(hash.hash == frame_hash[i].hash);
+    for (uint64_t j = 0; j < count; ++j) {
+      ASSERT_TRUE(EventEqual(event[j], frame[i][j]));
+    }
+  }
+
+  // Truncation is detected rather than read past
+  for (uint64_t i = 0; i < bytes; ++i) {
+    BitStreamInit(buffer, i, &s);
+    bool ok = DecodeTurn(&s, &decoded);
+    for (int f = 0; ok && f < 3; ++f) {
+      PlatformEvent event[MAX_TICK_EVENTS];
+      uint64_t count;
+      FrameHash hash;
+      ok = DecodeFrame(&s, event, MAX_TICK_EVENTS, &count, &hash);
+    }
+    ASSERT_TRUE(!ok);
+  }
+
+  // Other protocol versions are rejected
+  buffer[0] ^= 0xff;
+  BitStreamInit(buffer, bytes, &s);
+  ASSERT_TRUE(!DecodeTurn(&s, &decoded));
+}
+
+void
+NotifyTurnRoundTrip()
+{
+  PlatformEvent event[1] = {MouseEvent(MOUSE_UP, 12.f, 700.f, BUTTON_LEFT)};
+  NotifyTurn nt = {1ull << 20, 1, (1ull << 20) - 3};
+
+  uint8_t buffer[MAX_DATAGRAM];
+  BitStream s;
+  BitStreamInit(buffer, sizeof(buffer), &s);
+  EncodeNotifyTurn(&s, nt, event, 1, FrameHash{1ull << 20, 42});
+  ASSERT_TRUE(!s.error);
+
+  NotifyTurn decoded;
+  PlatformEvent decoded_event[MAX_TICK_EVENTS];
+  uint64_t count;
+  FrameHash hash;
+  BitStreamInit(buffer, BitStreamBytes(&s), &s);
+  ASSERT_TRUE(DecodeNotifyTurn(&s, &decoded, decoded_event, MAX_TICK_EVENTS,
+                               &count, &hash));
+  ASSERT_TRUE(hash.frame == 1ull << 20);
+  ASSERT_TRUE(hash.hash == 42);
+  ASSERT_TRUE(decoded.frame == nt.frame);
+  ASSERT_TRUE(decoded.player_id == nt.player_id);
+  ASSERT_TRUE(decoded.ack_sequence == nt.ack_sequence);
+  ASSERT_TRUE(count == 1);
+  ASSERT_TRUE(EventEqual(decoded_event[0], event[0]));
+}
+
+// Bytes on the wire for one NotifyTurn, before and after bit packing
+void
+BytesPerFrame()
+{
+  PlatformEvent typing[4] = {KeyEvent(KEY_DOWN, 'w'), KeyEvent(KEY_UP, 'w'),
+                             KeyEvent(KEY_DOWN, 'd'), KeyEvent(KEY_UP, 'd')};
+  PlatformEvent busy[MAX_TICK_EVENTS];
+  for (int i = 0; i < MAX_TICK_EVENTS; ++i) {
+    busy[i] = (i % 2) ? KeyEvent(KEY_DOWN, 'a' + i % 26)
+                      : MouseEvent(MOUSE_DOWN, 13.f * i, 7.f * i, BUTTON_LEFT);
+  }
+  PlatformEvent click = MouseEvent(MOUSE_DOWN, 640.f, 360.f, BUTTON_LEFT);
+  struct {
+    const char* name;
+    const PlatformEvent* event;
+    uint64_t count;
+  } load[] = {
+      {"idle", nullptr, 0},
+      {"click", &click, 1},
+      {"typing", typing, 4},
+      {"busy", busy, MAX_TICK_EVENTS},
+  };
+
+  printf("%-8s %8s %8s\n", "load", "raw", "packed");
+  for (auto& l : load) {
+    uint64_t raw = sizeof(NotifyTurn) + l.count * sizeof(PlatformEvent);
+    uint8_t buffer[MAX_DATAGRAM];
+    BitStream s;
+    BitStreamInit(buffer, sizeof(buffer), &s);
+    NotifyTurn nt = {60 * 60 * 10, 0, 60 * 60 * 10};
+    EncodeNotifyTurn(&s, nt, l.event, l.count, FrameHash{});
+    ASSERT_TRUE(!s.error);
+    printf("%-8s %8lu %8lu\n", l.name, raw, BitStreamBytes(&s));
+    ASSERT_TRUE(BitStreamBytes(&s) < raw);
+  }
+}
+
+int
+main()
+{
+  BitsRoundTrip();
+  VarintRoundTrip();
+  EventRoundTrip();
+  PositionQuantization();
+  TurnRoundTrip();
+  NotifyTurnRoundTrip();
+  BytesPerFrame();
+  return 0;
+}
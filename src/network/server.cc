@@ -1,66 +1,560 @@
+
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 
 #include "platform/platform.cc"
 #include "protocol.cc"
 
+// Players connected to one server process
+#define MAX_SERVER_PLAYER 4096
+// Games hosted by one server process
+#define MAX_GAME MAX_SERVER_PLAYER
+// Worker threads, a game is owned by shard (game % shard_count)
+#define MAX_SHARD 16
+// Peer lookup, open addressing kept at most half full
+#define PEER_TABLE_BITS 13
+#define PEER_TABLE_SIZE (1 << PEER_TABLE_BITS)
+// Messages in flight from ingress to one shard, power of 2
+#define SHARD_QUEUE 512
+// Largest Turn relayed to a shard
+#define MAX_PAYLOAD MAX_DATAGRAM
+// Largest NotifyTurn produced by a shard
+#define MAX_NOTIFY MAX_DATAGRAM
+#define MAX_BUFFER (4 * 1024)
+#define TIMEOUT_USEC (2 * 1000 * 1000)
+// Timer period of the inactive player scan
+#define DROP_INTERVAL_USEC (250 * 1000)
+
+static_assert(PEER_TABLE_SIZE >= 2 * MAX_SERVER_PLAYER,
+              "PEER_TABLE_SIZE must keep the peer table half empty");
+static_assert((SHARD_QUEUE & (SHARD_QUEUE - 1)) == 0,
+              "SHARD_QUEUE must be a power of 2");
+
 static ThreadInfo thread;
 
 struct ServerParam {
   const char* ip;
   const char* port;
+  uint64_t shard_count;
 };
 static ServerParam thread_param;
 
+// Ingress thread: one connected peer
 struct PlayerState {
   Udp4 peer;
+  bool used;
   uint64_t num_players;
+  // 1 + index into kGame, 0 while waiting in the lobby
+  uint64_t game;
   uint64_t game_id;
   uint64_t last_active;
-  uint64_t sequence;
   uint64_t player_id;
 };
-static PlayerState zero_player;
 
-static bool running = true;
-#define MAX_BUFFER (4 * 1024)
-#define MAX_PLAYER 2
-PlayerState player[MAX_PLAYER];
-uint64_t next_game_id = 1;
-bool game_ready;
+// Shard thread: one lockstep match
+struct GameState {
+  uint64_t game_id;
+  uint64_t player_count;
+  Udp4 peer[MAX_PLAYER];
+  // Cumulative ack, every sequence up to it has been relayed
+  uint64_t sequence[MAX_PLAYER];
+  bool active[MAX_PLAYER];
+};
+
+enum ShardMessageType {
+  kShardStart,
+  kShardTurn,
+  kShardDrop,
+};
+
+struct ShardStart {
+  uint64_t game_id;
+  uint64_t player_count;
+  Udp4 peer[MAX_PLAYER];
+};
+
+struct ShardMessage {
+  uint32_t type;
+  uint32_t game;
+  uint32_t player_id;
+  uint32_t bytes;
+  uint8_t payload[MAX_PAYLOAD];
+};
+
+// Single producer (ingress) single consumer (shard) ring
+struct ShardQueue {
+  alignas(64) std::atomic<uint64_t> read;
+  alignas(64) std::atomic<uint64_t> write;
+  ShardMessage message[SHARD_QUEUE];
+};
+
+// Fan-out of every Turn relayed by a shard in one pass
+struct ShardEgress {
+  uint8_t buffer[UDP_MAX_BATCH][MAX_NOTIFY];
+  uint64_t used_buffer;
+  UdpSend send[UDP_MAX_BATCH * MAX_PLAYER];
+  uint64_t used_send;
+};
+
+struct Shard {
+  ThreadInfo thread;
+  Udp4 location;
+  EventLoop loop;
+  EventWakeup wakeup;
+  // Ingress thread: messages committed since the last wakeup
+  bool signal_pending;
+  ShardQueue queue;
+  ShardEgress egress;
+};
+
+// Event tokens of the ingress thread
+enum ServerEvent {
+  kServerSocket,
+  kServerDrop,
+};
+
+// Players waiting for a game of one size
+struct Lobby {
+  uint32_t player[MAX_PLAYER];
+  uint64_t count;
+};
+
+struct Server {
+  PlayerState player[MAX_SERVER_PLAYER];
+  // 1 + index into player, 0 when empty
+  uint32_t peer_table[PEER_TABLE_SIZE];
+  uint32_t free_player[MAX_SERVER_PLAYER];
+  uint64_t free_player_count;
+  uint32_t free_game[MAX_GAME];
+  uint64_t free_game_count;
+  // Connected players per game, the slot is recycled at zero
+  uint64_t game_live[MAX_GAME];
+  Lobby lobby[MAX_PLAYER + 1];
+  uint64_t next_game_id;
+  uint64_t shard_count;
+};
+
+static volatile bool running = true;
+static Server kServer;
+static Shard kShard[MAX_SHARD];
+static GameState kGame[MAX_GAME];
 Clock_t server_clock;
-#define TIMEOUT_USEC (2 * 1000 * 1000)
+
+uint64_t
+PeerHash(const Udp4* peer)
+{
+  uint64_t lo, hi;
+  memcpy(&lo, peer->socket_address, sizeof(lo));
+  memcpy(&hi, peer->socket_address + sizeof(lo), sizeof(hi));
+  uint64_t h = (lo ^ (hi * 0xC2B2AE3D27D4EB4Full)) * 0x9E3779B97F4A7C15ull;
+  return h >> (64 - PEER_TABLE_BITS);
+}
+
+bool
+PeerEqual(const Udp4* lhs, const Udp4* rhs)
+{
+  return memcmp(lhs->socket_address, rhs->socket_address,
+                sizeof(Udp4::socket_address)) == 0;
+}
 
 int
-GetPlayerIndexFromPeer(Udp4* peer)
+GetPlayerIndexFromPeer(const Udp4* peer)
 {
-  for (int i = 0; i < MAX_PLAYER; ++i) {
-    if (memcmp(peer, &player[i].peer, sizeof(Udp4)) == 0) return i;
+  const uint64_t mask = PEER_TABLE_SIZE - 1;
+  for (uint64_t i = PeerHash(peer);; i = (i + 1) & mask) {
+    uint32_t entry = kServer.peer_table[i];
+    if (!entry) return -1;
+    if (PeerEqual(peer, &kServer.player[entry - 1].peer)) return entry - 1;
   }
+}
+
+void
+InsertPeer(uint32_t player_index)
+{
+  const uint64_t mask = PEER_TABLE_SIZE - 1;
+  uint64_t i = PeerHash(&kServer.player[player_index].peer);
+  while (kServer.peer_table[i]) i = (i + 1) & mask;
+  kServer.peer_table[i] = player_index + 1;
+}
 
-  return -1;
+// Backward shift deletion keeps probe sequences intact without tombstones
+void
+RemovePeer(uint32_t player_index)
+{
+  const uint64_t mask = PEER_TABLE_SIZE - 1;
+  uint64_t i = PeerHash(&kServer.player[player_index].peer);
+  while (kServer.peer_table[i] != player_index + 1) i = (i + 1) & mask;
+
+  uint64_t j = i;
+  while (1) {
+    kServer.peer_table[i] = 0;
+    do {
+      j = (j + 1) & mask;
+      if (!kServer.peer_table[j]) return;
+      uint64_t home = PeerHash(&kServer.player[kServer.peer_table[j] - 1].peer);
+      // Entry may move into the hole when its home is not in (i, j]
+      if (((j - home) & mask) >= ((j - i) & mask)) break;
+    } while (1);
+    kServer.peer_table[i] = kServer.peer_table[j];
+    i = j;
+  }
 }
 
 int
 GetNextPlayerIndex()
 {
-  for (int i = 0; i < MAX_PLAYER; ++i) {
-    if (memcmp(&zero_player, &player[i], sizeof(PlayerState)) == 0) return i;
+  if (!kServer.free_player_count) return -1;
+  return kServer.free_player[--kServer.free_player_count];
+}
+
+int
+GetNextGameIndex()
+{
+  if (!kServer.free_game_count) return -1;
+  return kServer.free_game[--kServer.free_game_count];
+}
+
+Shard*
+GetShard(uint64_t game_index)
+{
+  return &kShard[game_index % kServer.shard_count];
+}
+
+// Returns a free message slot, or nullptr when the shard is saturated
+ShardMessage*
+ShardReserve(Shard* shard)
+{
+  ShardQueue* q = &shard->queue;
+  uint64_t write = q->write.load(std::memory_order_relaxed);
+  if (write - q->read.load(std::memory_order_acquire) == SHARD_QUEUE)
+    return nullptr;
+  return &q->message[write % SHARD_QUEUE];
+}
+
+void
+ShardCommit(Shard* shard)
+{
+  ShardQueue* q = &shard->queue;
+  q->write.store(q->write.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+  shard->signal_pending = true;
+}
+
+// One wakeup per shard covers every message committed before it
+void
+ShardSignal()
+{
+  for (uint64_t i = 0; i < kServer.shard_count; ++i) {
+    if (!kShard[i].signal_pending) continue;
+    kShard[i].signal_pending = false;
+    platform::event_signal(kShard[i].wakeup);
+  }
+}
+
+// Control messages must not be lost, wait for the shard to drain
+ShardMessage*
+ShardReserveBlocking(Shard* shard)
+{
+  ShardMessage* msg;
+  while (!(msg = ShardReserve(shard))) {
+    ShardSignal();
+    platform::thread_yield();
+  }
+  return msg;
+}
+
+ShardMessage*
+ShardPeek(Shard* shard)
+{
+  ShardQueue* q = &shard->queue;
+  uint64_t read = q->read.load(std::memory_order_relaxed);
+  if (read == q->write.load(std::memory_order_acquire)) return nullptr;
+  return &q->message[read % SHARD_QUEUE];
+}
+
+void
+ShardPop(Shard* shard)
+{
+  ShardQueue* q = &shard->queue;
+  q->read.store(q->read.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+}
+
+void
+SendNotifyStart(Udp4 location, const PlayerState* p)
+{
+  NotifyStart response;
+  response.game_id = p->game_id;
+  response.player_id = p->player_id;
+  response.player_count = p->num_players;
+  if (!udp::SendTo(location, p->peer, &response, sizeof(NotifyStart)))
+    puts("greet failed");
+}
+
+// Moves a full lobby into a new game owned by one shard
+void
+StartGame(Udp4 location, Lobby* lobby, uint64_t num_players)
+{
+  int game_index = GetNextGameIndex();
+  if (game_index == -1) return;
+
+  uint64_t game_id = kServer.next_game_id++;
+  ShardMessage* msg = ShardReserveBlocking(GetShard(game_index));
+  msg->type = kShardStart;
+  msg->game = game_index;
+  msg->bytes = sizeof(ShardStart);
+  ShardStart* start = (ShardStart*)msg->payload;
+  start->game_id = game_id;
+  start->player_count = num_players;
+
+  for (uint64_t i = 0; i < num_players; ++i) {
+    PlayerState* p = &kServer.player[lobby->player[i]];
+    printf("greet player index %u\n", lobby->player[i]);
+    p->game = game_index + 1;
+    p->game_id = game_id;
+    p->player_id = i;
+    start->peer[i] = p->peer;
+    SendNotifyStart(location, p);
   }
+  ShardCommit(GetShard(game_index));
 
-  return -1;
+  kServer.game_live[game_index] = num_players;
+  lobby->count = 0;
+}
+
+void
+AcceptPlayer(Udp4 location, const Udp4& peer, uint64_t num_players,
+             uint64_t rt_usec)
+{
+  if (num_players == 0 || num_players > MAX_PLAYER) return;
+  // No room for clients on this server
+  int player_index = GetNextPlayerIndex();
+  if (player_index == -1) return;
+
+  printf("Accepted %d\n", player_index);
+  PlayerState* p = &kServer.player[player_index];
+  *p = PlayerState{};
+  p->peer = peer;
+  p->used = true;
+  p->num_players = num_players;
+  p->last_active = rt_usec;
+  InsertPeer(player_index);
+
+  Lobby* lobby = &kServer.lobby[num_players];
+  lobby->player[lobby->count++] = player_index;
+  if (lobby->count >= num_players) StartGame(location, lobby, num_players);
+}
+
+void
+DropPlayer(uint32_t player_index)
+{
+  PlayerState* p = &kServer.player[player_index];
+  if (p->game) {
+    uint64_t game_index = p->game - 1;
+    ShardMessage* msg = ShardReserveBlocking(GetShard(game_index));
+    msg->type = kShardDrop;
+    msg->game = game_index;
+    msg->player_id = p->player_id;
+    msg->bytes = 0;
+    ShardCommit(GetShard(game_index));
+
+    // The shard observes the drop before any later start for this slot
+    if (--kServer.game_live[game_index] == 0)
+      kServer.free_game[kServer.free_game_count++] = game_index;
+  } else {
+    Lobby* lobby = &kServer.lobby[p->num_players];
+    for (uint64_t i = 0; i < lobby->count; ++i) {
+      if (lobby->player[i] != player_index) continue;
+      lobby->player[i] = lobby->player[--lobby->count];
+      break;
+    }
+  }
+
+  RemovePeer(player_index);
+  *p = PlayerState{};
+  kServer.free_player[kServer.free_player_count++] = player_index;
+  printf("dropped player %u\n", player_index);
 }
 
 void
 drop_inactive_players(uint64_t rt_usec)
 {
-  for (int i = 0; i < MAX_PLAYER; ++i) {
-    if (memcmp(&zero_player, &player[i], sizeof(PlayerState)) == 0) continue;
-    if (rt_usec - player[i].last_active > TIMEOUT_USEC) {
-      player[i] = PlayerState{};
-      printf("dropped player %d\n", i);
+  for (int i = 0; i < MAX_SERVER_PLAYER; ++i) {
+    if (!kServer.player[i].used) continue;
+    if (rt_usec - kServer.player[i].last_active > TIMEOUT_USEC) DropPlayer(i);
+  }
+}
+
+void
+ShardFlush(const Shard* shard, ShardEgress* egress)
+{
+  int sent;
+  if (egress->used_send &&
+      !udp::SendToBatch(shard->location, egress->send, egress->used_send,
+                        &sent))
+    puts("server send failed");
+
+  egress->used_buffer = 0;
+  egress->used_send = 0;
+}
+
+// Echo the next in-order frame of pid to game participants
+// The frame counts as relayed only once it is encoded, so a failure leaves
+// it for the client's resend.
+void
+ShardRelay(const Shard* shard, GameState* game, uint64_t pid,
+           const PlatformEvent* event, uint64_t event_count,
+           const FrameHash& hash, ShardEgress* egress)
+{
+  uint64_t sequence = game->sequence[pid] + 1;
+
+  // NotifyTurn
+  if (egress->used_buffer == UDP_MAX_BATCH) ShardFlush(shard, egress);
+  uint8_t* out_buffer = egress->buffer[egress->used_buffer];
+  NotifyTurn nt;
+  nt.frame = sequence;
+  nt.player_id = pid;
+  nt.ack_sequence = sequence;
+  BitStream out;
+  BitStreamInit(out_buffer, MAX_NOTIFY, &out);
+  EncodeNotifyTurn(&out, nt, event, event_count, hash);
+  if (out.error) return;
+  game->sequence[pid] = sequence;
+  egress->used_buffer += 1;
+
+  for (uint64_t p = 0; p < game->player_count; ++p) {
+    if (!game->active[p]) continue;
+
+    UdpSend* send = &egress->send[egress->used_send++];
+    send->peer = game->peer[p];
+    send->buffer = out_buffer;
+    send->len = BitStreamBytes(&out);
+  }
+}
+
+void
+ShardTurn(const Shard* shard, GameState* game, const ShardMessage* msg,
+          ShardEgress* egress)
+{
+  uint64_t pid = msg->player_id;
+  if (!game->active[pid]) return;
+
+  // The peer, not the packet, identifies the player
+  BitStream in;
+  BitStreamInit((void*)msg->payload, msg->bytes, &in);
+  Turn packet;
+  if (!DecodeTurn(&in, &packet)) return;
+#if 0
+  printf("SvrRcv [ %d bytes ] [ %lu sequence ] [ %lu frames ] [ %lu game_id ]\n",
+         msg->bytes, packet.sequence, packet.frame_count, game->game_id);
+#endif
+  PlatformEvent event[MAX_TICK_EVENTS];
+  for (uint64_t i = 0; i < packet.frame_count; ++i) {
+    uint64_t event_count;
+    FrameHash hash;
+    if (!DecodeFrame(&in, event, MAX_TICK_EVENTS, &event_count, &hash)) return;
+
+    // A Turn carries every frame after the client's ack, which never
+    // passes sequence, so a reordered Turn cannot start beyond a gap and
+    // nothing needs holding. Frames already relayed are redundancy, frames
+    // past a gap are dropped and resent by the client with the gap.
+    uint64_t sequence = packet.sequence + i;
+    if (sequence - game->sequence[pid] != 1) continue;
+
+    ShardRelay(shard, game, pid, event, event_count, hash, egress);
+  }
+}
+
+uint64_t
+shard_main(void* void_arg)
+{
+  Shard* shard = (Shard*)void_arg;
+  ShardEgress* egress = &shard->egress;
+
+  while (running) {
+    ShardMessage* msg;
+    while ((msg = ShardPeek(shard))) {
+      GameState* game = &kGame[msg->game];
+      switch (msg->type) {
+        case kShardStart: {
+          const ShardStart* start = (const ShardStart*)msg->payload;
+          *game = GameState{};
+          game->game_id = start->game_id;
+          game->player_count = start->player_count;
+          for (uint64_t i = 0; i < start->player_count; ++i) {
+            game->peer[i] = start->peer[i];
+            game->active[i] = true;
+          }
+        } break;
+        case kShardTurn: {
+          ShardTurn(shard, game, msg, egress);
+        } break;
+        case kShardDrop: {
+          game->active[msg->player_id] = false;
+          bool any_active = false;
+          for (uint64_t i = 0; i < game->player_count; ++i) {
+            any_active |= game->active[i];
+          }
+          // Queued sends copied the peer, the slot is safe to clear
+          if (!any_active) *game = GameState{};
+        } break;
+      }
+      ShardPop(shard);
+    }
+    ShardFlush(shard, egress);
+
+    // Sleep until ingress commits more work
+    uint64_t token;
+    if (platform::event_wait(&shard->loop, -1, &token, 1) < 0) {
+      puts("shard: fail event_wait");
+      return 1;
     }
   }
+
+  return 0;
+}
+
+void
+ServerIngress(Udp4 location, const Udp4& peer, const uint8_t* in_buffer,
+              uint16_t received_bytes, uint64_t realtime_usec)
+{
+  int pidx = GetPlayerIndexFromPeer(&peer);
+
+  // Handshake packet
+  if (received_bytes >= sizeof(Handshake) &&
+      strncmp(GREETING, (const char*)in_buffer, greeting_size) == 0) {
+    const Handshake* header = (const Handshake*)(in_buffer);
+    if (pidx == -1) {
+      AcceptPlayer(location, peer, header->num_players, realtime_usec);
+    } else if (kServer.player[pidx].game) {
+      // Duplicate handshake, the NotifyStart was lost
+      SendNotifyStart(location, &kServer.player[pidx]);
+    }
+    return;
+  }
+
+  // Filter Identified clients
+  if (pidx == -1) return;
+
+  // Mark player connection active
+  PlayerState* p = &kServer.player[pidx];
+  p->last_active = realtime_usec;
+
+  // Filter for game-ready clients
+  if (!p->game) return;
+  if (received_bytes > MAX_PAYLOAD) return;
+
+  // A saturated shard drops the datagram, the client resends history
+  Shard* shard = GetShard(p->game - 1);
+  ShardMessage* msg = ShardReserve(shard);
+  if (!msg) return;
+  msg->type = kShardTurn;
+  msg->game = p->game - 1;
+  msg->player_id = p->player_id;
+  msg->bytes = received_bytes;
+  memcpy(msg->payload, in_buffer, received_bytes);
+  ShardCommit(shard);
 }
 
 uint64_t
@@ -68,7 +562,9 @@ server_main(void* void_arg)
 {
   ServerParam* arg = (ServerParam*)void_arg;
 
-  uint8_t in_buffer[MAX_BUFFER];
+  static uint8_t in_buffer[UDP_MAX_BATCH][MAX_BUFFER];
+  static uint16_t received_bytes[UDP_MAX_BATCH];
+  static Udp4 peer[UDP_MAX_BATCH];
   if (!udp::Init()) {
     puts("server: fail init");
     return 1;
@@ -88,122 +584,93 @@ server_main(void* void_arg)
     return 3;
   }
 
-  uint64_t realtime_usec = 0;
-  uint64_t time_step = 1000;
-  platform::clock_init(time_step, &server_clock);
-  while (running) {
-    uint16_t received_bytes;
-    Udp4 peer;
+  // Lowest indices are handed out first
+  for (int i = 0; i < MAX_SERVER_PLAYER; ++i) {
+    kServer.free_player[i] = MAX_SERVER_PLAYER - 1 - i;
+  }
+  kServer.free_player_count = MAX_SERVER_PLAYER;
+  for (int i = 0; i < MAX_GAME; ++i) {
+    kServer.free_game[i] = MAX_GAME - 1 - i;
+  }
+  kServer.free_game_count = MAX_GAME;
+  kServer.next_game_id = 1;
+  kServer.shard_count = CLAMP(arg->shard_count, (uint64_t)1, MAX_SHARD);
+
+  EventLoop loop;
+  if (!platform::event_create(&loop) ||
+      !platform::event_add_socket(&loop, location, kServerSocket) ||
+      !platform::event_add_timer(&loop, DROP_INTERVAL_USEC, kServerDrop)) {
+    puts("server: fail event loop");
+    return 4;
+  }
 
-    uint64_t sleep_usec;
-    if (platform::clock_sync(&server_clock, &sleep_usec)) {
-      realtime_usec += time_step;
-    }
-    if (!udp::ReceiveAny(location, MAX_BUFFER, in_buffer, &received_bytes,
-                         &peer)) {
-      if (udp_errno) running = false;
-      if (udp_errno) printf("udp_errno %d\n", udp_errno);
-      drop_inactive_players(realtime_usec);
-      platform::sleep_usec(sleep_usec);
-      continue;
+  printf("Server shards %lu\n", kServer.shard_count);
+  for (uint64_t i = 0; i < kServer.shard_count; ++i) {
+    kShard[i].location = location;
+    kShard[i].thread.func = shard_main;
+    kShard[i].thread.arg = &kShard[i];
+    if (!platform::event_create(&kShard[i].loop) ||
+        !platform::event_add_wakeup(&kShard[i].loop, 0, &kShard[i].wakeup) ||
+        !platform::thread_create(&kShard[i].thread)) {
+      puts("server: fail shard");
+      return 5;
     }
+  }
 
-    int pidx = GetPlayerIndexFromPeer(&peer);
-
-    // Handshake packet
-    if (received_bytes >= sizeof(Handshake) &&
-        strncmp(GREETING, (char*)in_buffer, greeting_size) == 0) {
-      // No room for clients on this server
-      int player_index = GetNextPlayerIndex();
-      if (player_index == -1) continue;
-      // Duplicate handshake packet, idx already assigned
-      if (pidx != -1) continue;
-
-      Handshake* header = (Handshake*)(in_buffer);
-      uint64_t num_players = header->num_players;
-      printf("Accepted %d\n", player_index);
-      player[player_index].peer = peer;
-      player[player_index].num_players = num_players;
-      player[player_index].game_id = 0;
-      player[player_index].last_active = realtime_usec;
-      player[player_index].sequence = 0;
-
-      int ready_players = 0;
-      for (int i = 0; i < MAX_PLAYER; ++i) {
-        if (player[i].game_id) continue;
-        if (player[i].num_players != num_players) continue;
-        ++ready_players;
-      }
-
-      if (ready_players >= num_players) {
-        NotifyStart* response = (NotifyStart*)(in_buffer);
-
-        uint64_t player_id = 0;
-        for (int i = 0; i < MAX_PLAYER; ++i) {
-          if (player[i].game_id) continue;
-          if (player[i].num_players != num_players) continue;
-
-          printf("greet player index %d\n", i);
-          response->player_id = player_id;
-          response->player_count = num_players;
-          response->game_id = next_game_id;
-          if (!udp::SendTo(location, player[i].peer, in_buffer,
-                           sizeof(NotifyStart)))
-            puts("greet failed");
-          player[i].game_id = next_game_id;
-          player[i].player_id = player_id;
-          ++player_id;
-        }
-        ++next_game_id;
-      }
+  platform::clock_init(1000, &server_clock);
+  const uint64_t start_tsc = rdtsc();
+  while (running) {
+    uint64_t token[MAX_EVENT_SOURCE];
+    int event_count =
+        platform::event_wait(&loop, -1, token, MAX_EVENT_SOURCE);
+    if (event_count < 0) {
+      puts("server: fail event_wait");
+      running = false;
     }
 
-    // Filter Identified clients
-    if (pidx == -1) continue;
-
-    // Mark player connection active
-    player[pidx].last_active = realtime_usec;
-
-    // Filter for game-ready clients
-    if (!player[pidx].game_id) continue;
-
-    Turn* packet = (Turn*)in_buffer;
-    uint64_t game_id = player[pidx].game_id;
-#if 0
-    printf(
-        "SvrRcv [ %d socket ] [ %d bytes ] [ %lu sequence ] [ %lu game_id ]\n",
-        location.socket, received_bytes, packet->sequence, game_id);
-#endif
-    // Require stream integrity
-    if (packet->sequence - player[pidx].sequence != 1) continue;
-    player[pidx].sequence = packet->sequence;
-
-    // NotifyTurn
-    uint64_t event_bytes = received_bytes - sizeof(Turn);
-    uint8_t out_buffer[MAX_BUFFER];
-    NotifyTurn* nt = (NotifyTurn*)out_buffer;
-    nt->frame = packet->sequence;
-    nt->player_id = player[pidx].player_id;
-    nt->ack_sequence = packet->sequence;
-    memcpy(nt->event, packet->event, event_bytes);
-
-    // Echo bytes to game participants
-    for (int i = 0; i < MAX_PLAYER; ++i) {
-      if (player[i].game_id != game_id) continue;
-
-      if (!udp::SendTo(location, player[i].peer, out_buffer,
-                       event_bytes + sizeof(NotifyTurn))) {
-        puts("server send failed");
-        break;
+    uint64_t realtime_usec =
+        platform::tscdelta_to_usec(&server_clock, rdtsc() - start_tsc);
+    for (int e = 0; e < event_count; ++e) {
+      switch (token[e]) {
+        case kServerSocket: {
+          int received_count;
+          do {
+            if (!udp::ReceiveAnyBatch(location, MAX_BUFFER, in_buffer[0],
+                                      UDP_MAX_BATCH, received_bytes, peer,
+                                      &received_count)) {
+              if (udp_errno) running = false;
+              if (udp_errno) printf("udp_errno %d\n", udp_errno);
+              break;
+            }
+
+            for (int i = 0; i < received_count; ++i) {
+              ServerIngress(location, peer[i], in_buffer[i],
+                            received_bytes[i], realtime_usec);
+            }
+            ShardSignal();
+          } while (received_count == UDP_MAX_BATCH);
+        } break;
+        case kServerDrop: {
+          drop_inactive_players(realtime_usec);
+        } break;
       }
     }
+    ShardSignal();
+  }
+
+  // Wake shards to observe shutdown
+  for (uint64_t i = 0; i < kServer.shard_count; ++i) {
+    platform::event_signal(kShard[i].wakeup);
+    platform::thread_join(&kShard[i].thread);
+    platform::event_destroy(&kShard[i].loop);
   }
+  platform::event_destroy(&loop);
 
   return 0;
 }
 
 bool
-CreateNetworkServer(const char* ip, const char* port)
+CreateNetworkServer(const char* ip, const char* port, uint64_t shard_count = 1)
 {
   if (thread.id) return false;
 
@@ -211,6 +678,7 @@ CreateNetworkServer(const char* ip, const char* port)
   thread.arg = &thread_param;
   thread_param.ip = ip;
   thread_param.port = port;
+  thread_param.shard_count = shard_count;
   return platform::thread_create(&thread);
 }
 
@@ -222,4 +690,3 @@ WaitForNetworkServer()
   platform::thread_join(&thread);
   return thread.return_value;
 }
-
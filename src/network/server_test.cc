@@ -0,0 +1,153 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "server.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+static Shard kTestShard;
+static GameState kTestGame;
+static ShardMessage kMessage;
+
+void
+StartGame()
+{
+  kTestGame = GameState{};
+  kTestGame.player_count = 2;
+  kTestGame.active[0] = true;
+  kTestGame.active[1] = true;
+  kTestShard.egress.used_buffer = 0;
+  kTestShard.egress.used_send = 0;
+}
+
+// Turn of player 1 with frames [sequence, sequence + count), each holding
+// one key event naming its sequence
+void
+SendTurn(uint64_t sequence, uint64_t count)
+{
+  kMessage.type = kShardTurn;
+  kMessage.player_id = 1;
+  BitStream s;
+  BitStreamInit(kMessage.payload, MAX_PAYLOAD, &s);
+  EncodeTurn(&s, Turn{sequence, 1, count});
+  for (uint64_t i = 0; i < count; ++i) {
+    PlatformEvent event = {};
+    event.type = KEY_DOWN;
+    event.key = 'a' + (sequence + i) % 26;
+    EncodeFrame(&s, &event, 1, FrameHash{});
+  }
+  ASSERT_TRUE(!s.error);
+  kMessage.bytes = BitStreamBytes(&s);
+  ShardTurn(&kTestShard, &kTestGame, &kMessage, &kTestShard.egress);
+}
+
+// Relayed frames in egress order are exactly first..last
+void
+ExpectRelayed(uint64_t first, uint64_t last)
+{
+  ShardEgress* egress = &kTestShard.egress;
+  ASSERT_TRUE(egress->used_buffer == last - first + 1);
+  ASSERT_TRUE(egress->used_send == 2 * egress->used_buffer);
+  for (uint64_t i = 0; i < egress->used_buffer; ++i) {
+    BitStream s;
+    BitStreamInit(egress->buffer[i], MAX_NOTIFY, &s);
+    NotifyTurn nt;
+    PlatformEvent event[MAX_TICK_EVENTS];
+    uint64_t count;
+    FrameHash hash;
+    ASSERT_TRUE(
+        DecodeNotifyTurn(&s, &nt, event, MAX_TICK_EVENTS, &count, &hash));
+    ASSERT_TRUE(nt.player_id == 1);
+    ASSERT_TRUE(nt.frame == first + i);
+    ASSERT_TRUE(nt.ack_sequence == first + i);
+    ASSERT_TRUE(count == 1);
+    ASSERT_TRUE(event[0].key == (char)('a' + (first + i) % 26));
+  }
+  ASSERT_TRUE(kTestGame.sequence[1] == last);
+  ASSERT_TRUE(kTestGame.sequence[0] == 0);
+  egress->used_buffer = 0;
+  egress->used_send = 0;
+}
+
+void
+InOrder()
+{
+  StartGame();
+  SendTurn(1, 3);
+  ExpectRelayed(1, 3);
+  SendTurn(4, 1);
+  ExpectRelayed(4, 4);
+}
+
+// Resent history overlaps what was relayed, only new frames go out
+void
+Duplicate()
+{
+  StartGame();
+  SendTurn(1, 3);
+  ExpectRelayed(1, 3);
+  SendTurn(1, 3);
+  ASSERT_TRUE(kTestShard.egress.used_buffer == 0);
+  SendTurn(2, 4);
+  ExpectRelayed(4, 5);
+}
+
+// A Turn past a gap is dropped, the client's resend from its ack fills the
+// gap and everything after it
+void
+OutOfOrder()
+{
+  StartGame();
+  SendTurn(1, 2);
+  ExpectRelayed(1, 2);
+  SendTurn(5, 2);
+  ASSERT_TRUE(kTestShard.egress.used_buffer == 0);
+  ASSERT_TRUE(kTestGame.sequence[1] == 2);
+  SendTurn(3, 4);
+  ExpectRelayed(3, 6);
+  // The reordered older Turn arrives last
+  SendTurn(3, 1);
+  ASSERT_TRUE(kTestShard.egress.used_buffer == 0);
+}
+
+// Input of a dropped player is ignored
+void
+Inactive()
+{
+  StartGame();
+  kTestGame.active[1] = false;
+  SendTurn(1, 2);
+  ASSERT_TRUE(kTestShard.egress.used_buffer == 0);
+  ASSERT_TRUE(kTestGame.sequence[1] == 0);
+}
+
+// A frame that cannot be encoded is not relayed and stays next in line
+void
+EncodeFails()
+{
+  StartGame();
+  static PlatformEvent event[8 * MAX_NOTIFY];
+  for (uint64_t i = 0; i < 8 * MAX_NOTIFY; ++i) {
+    event[i].type = KEY_DOWN;
+    event[i].key = 'a';
+  }
+  ShardRelay(&kTestShard, &kTestGame, 1, event, 8 * MAX_NOTIFY, FrameHash{},
+             &kTestShard.egress);
+  ASSERT_TRUE(kTestShard.egress.used_buffer == 0);
+  ASSERT_TRUE(kTestGame.sequence[1] == 0);
+  SendTurn(1, 1);
+  ExpectRelayed(1, 1);
+}
+
+int
+main()
+{
+  InOrder();
+  Duplicate();
+  OutOfOrder();
+  Inactive();
+  EncodeFails();
+  printf("server ok\n");
+  return 0;
+}
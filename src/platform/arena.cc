@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "memory.h"
+
+// Linear allocator: allocations bump a cursor and are freed all at once by
+// ArenaReset, or back to an ArenaMark with ArenaRestore.
+// A fixed arena wraps caller memory. A growable arena reserves address
+// space and commits pages as the cursor reaches them.
+
+// Pages committed at a time by a growable arena
+#define ARENA_COMMIT_BYTES (64 * 1024)
+
+struct Arena {
+  uint8_t* base;
+  uint64_t used;
+  // Usable bytes, grows up to reserved for a growable arena
+  uint64_t committed;
+  // 0 for a fixed arena
+  uint64_t reserved;
+  // Largest used since ArenaInit
+  uint64_t high_water;
+};
+
+void
+ArenaInit(Arena* arena, void* buffer, uint64_t bytes)
+{
+  *arena = Arena{};
+  arena->base = (uint8_t*)buffer;
+  arena->committed = bytes;
+}
+
+// Growable arena of at most reserve_bytes
+bool
+ArenaReserve(Arena* arena, uint64_t reserve_bytes)
+{
+  uint64_t page = platform::memory_page_size();
+  reserve_bytes = (reserve_bytes + page - 1) / page * page;
+  void* base = platform::memory_reserve(reserve_bytes);
+  if (!base) return false;
+  *arena = Arena{};
+  arena->base = (uint8_t*)base;
+  arena->reserved = reserve_bytes;
+  return true;
+}
+
+// Growable arenas give their address space back
+void
+ArenaRelease(Arena* arena)
+{
+  if (arena->reserved) platform::memory_release(arena->base, arena->reserved);
+  *arena = Arena{};
+}
+
+// Returns bytes aligned to align (a power of 2), nullptr when exhausted
+void*
+ArenaPush(Arena* arena, uint64_t bytes, uint64_t align = 16)
+{
+  uint64_t address = (uint64_t)(arena->base + arena->used);
+  uint64_t padding = (align - (address & (align - 1))) & (align - 1);
+  uint64_t start = arena->used + padding;
+  uint64_t end = start + bytes;
+  if (end > arena->committed) {
+    if (end > arena->reserved) return nullptr;
+    uint64_t commit = (end + ARENA_COMMIT_BYTES - 1) / ARENA_COMMIT_BYTES *
+                      ARENA_COMMIT_BYTES;
+    if (commit > arena->reserved) commit = arena->reserved;
+    if (!platform::memory_commit(arena->base + arena->committed,
+                                 commit - arena->committed)) {
+      return nullptr;
+    }
+    arena->committed = commit;
+  }
+
+  arena->used = end;
+  if (end > arena->high_water) arena->high_water = end;
+  return arena->base + start;
+}
+
+template <typename T>
+T*
+ArenaPushArray(Arena* arena, uint64_t count)
+{
+  return (T*)ArenaPush(arena, count * sizeof(T), alignof(T));
+}
+
+// Null terminated copy of len bytes of str
+char*
+ArenaPushString(Arena* arena, const char* str, uint64_t len)
+{
+  char* copy = (char*)ArenaPush(arena, len + 1, 1);
+  if (!copy) return nullptr;
+  memcpy(copy, str, len);
+  copy[len] = 0;
+  return copy;
+}
+
+// Committed pages are kept for reuse
+void
+ArenaReset(Arena* arena)
+{
+  arena->used = 0;
+}
+
+uint64_t
+ArenaMark(const Arena* arena)
+{
+  return arena->used;
+}
+
+// Frees everything pushed since mark was taken
+void
+ArenaRestore(Arena* arena, uint64_t mark)
+{
+  if (mark < arena->used) arena->used = mark;
+}
@@ -0,0 +1,77 @@
+#include <cassert>
+#include <cstdio>
+
+#include "platform.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+void
+Fixed()
+{
+  static uint8_t buffer[256];
+  Arena arena;
+  ArenaInit(&arena, buffer, sizeof(buffer));
+
+  uint8_t* a = ArenaPushArray<uint8_t>(&arena, 3);
+  uint64_t* b = ArenaPushArray<uint64_t>(&arena, 2);
+  ASSERT_TRUE(a == buffer);
+  ASSERT_TRUE((uint64_t)b % alignof(uint64_t) == 0);
+  ASSERT_TRUE((uint8_t*)b - a == 8);
+  ASSERT_TRUE(arena.used == 24);
+
+  // Restore frees everything after the mark
+  uint64_t mark = ArenaMark(&arena);
+  char* s = ArenaPushString(&arena, "scratch", 7);
+  ASSERT_TRUE(s && strcmp(s, "scratch") == 0);
+  ArenaRestore(&arena, mark);
+  ASSERT_TRUE(ArenaPushArray<uint8_t>(&arena, 1) == (uint8_t*)s);
+
+  // Exhausted without moving the cursor
+  uint64_t used = arena.used;
+  ASSERT_TRUE(!ArenaPush(&arena, sizeof(buffer)));
+  ASSERT_TRUE(arena.used == used);
+  ASSERT_TRUE(ArenaPush(&arena, sizeof(buffer) - used, 1));
+
+  ArenaReset(&arena);
+  ASSERT_TRUE(ArenaPush(&arena, 1) == buffer);
+  ASSERT_TRUE(arena.high_water == sizeof(buffer));
+}
+
+void
+Growable()
+{
+  Arena arena;
+  const uint64_t kReserve = 1 << 24;
+  ASSERT_TRUE(ArenaReserve(&arena, kReserve));
+  ASSERT_TRUE(arena.committed == 0);
+
+  // Commits in steps as the cursor advances
+  uint8_t* first = ArenaPushArray<uint8_t>(&arena, 100);
+  ASSERT_TRUE(arena.committed == ARENA_COMMIT_BYTES);
+  memset(first, 1, 100);
+  uint8_t* big = ArenaPushArray<uint8_t>(&arena, 3 * ARENA_COMMIT_BYTES);
+  memset(big, 2, 3 * ARENA_COMMIT_BYTES);
+  ASSERT_TRUE(arena.committed == 4 * ARENA_COMMIT_BYTES);
+  ASSERT_TRUE(first[99] == 1);
+
+  // Pages stay committed across resets
+  ArenaReset(&arena);
+  ASSERT_TRUE(ArenaPushArray<uint8_t>(&arena, 1) == first);
+  ASSERT_TRUE(arena.committed == 4 * ARENA_COMMIT_BYTES);
+
+  // Up to the reservation and no further
+  ArenaReset(&arena);
+  ASSERT_TRUE(ArenaPush(&arena, kReserve, 1));
+  ASSERT_TRUE(!ArenaPush(&arena, 1, 1));
+  ArenaRelease(&arena);
+  ASSERT_TRUE(!arena.base);
+}
+
+int
+main()
+{
+  Fixed();
+  Growable();
+  printf("arena ok\n");
+  return 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "udp.h"
+
+// Readiness notification for sockets, periodic timers and cross-thread
+// wakeups. Each source is registered with a caller chosen token that
+// event_wait reports back. Timers and wakeups are re-armed by event_wait,
+// sockets are level triggered and must be drained by the caller.
+
+#define MAX_EVENT_SOURCE 8
+
+enum EventSourceKind {
+  kEventSocket,
+  kEventTimer,
+  kEventWakeup,
+};
+
+struct EventSource {
+  EventSourceKind kind;
+  uint64_t token;
+#ifdef _WIN32
+  SOCKET socket;
+  // Socket readiness from WSAEventSelect or an auto-reset wakeup event
+  HANDLE event;
+  uint64_t period_msec;
+  uint64_t deadline_msec;
+#else
+  int fd;
+#endif
+};
+
+struct EventLoop {
+#ifndef _WIN32
+  // epoll or kqueue descriptor
+  int fd;
+#endif
+  EventSource source[MAX_EVENT_SOURCE];
+  int used_source;
+};
+
+// Thread-safe handle used to interrupt an event_wait
+struct EventWakeup {
+  EventLoop* loop;
+  int source;
+};
+
+namespace platform
+{
+bool event_create(EventLoop* loop);
+void event_destroy(EventLoop* loop);
+bool event_add_socket(EventLoop* loop, Udp4 location, uint64_t token);
+bool event_add_timer(EventLoop* loop, uint64_t period_usec, uint64_t token);
+bool event_add_wakeup(EventLoop* loop, uint64_t token, EventWakeup* wakeup);
+void event_signal(EventWakeup wakeup);
+// Blocks up to timeout_usec (negative waits forever) for ready sources.
+// Returns the number of tokens written, 0 on timeout and -1 on error.
+int event_wait(EventLoop* loop, int64_t timeout_usec, uint64_t* token,
+               int max_token);
+}  // namespace platform
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Virtual memory: address space is reserved up front and backed by pages
+// only once committed. Sizes are rounded up to memory_page_size().
+namespace platform
+{
+uint64_t memory_page_size();
+// Returns inaccessible address space, nullptr on failure
+void* memory_reserve(uint64_t bytes);
+// Makes [ptr, ptr + bytes) of a reservation readable and writable
+bool memory_commit(void* ptr, uint64_t bytes);
+void memory_release(void* ptr, uint64_t bytes);
+}  // namespace platform
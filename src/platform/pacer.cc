@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "x64_intrin.h"
+
+// Waits for the next clock_sync deadline: sleeps while the deadline is
+// further away than the sleep overshoot the OS has shown so far, then
+// spins out the remainder.
+//
+// Overshoot (woken - requested) is kept as a histogram that halves every
+// PACER_DECAY samples, so the margin follows the recent distribution.
+// When the percentile lands in the last, unbounded bucket the margin
+// outlasts any frame and the pacer spins, decaying the histogram every
+// PACER_DECAY frames until sleeping looks safe again.
+
+// Overshoot and frame deviation histograms: PACER_LINEAR_BUCKETS of
+// PACER_BUCKET_USEC, then each doubling of the range split in
+// PACER_OCTAVE_BUCKETS. The top bucket starts past 5 seconds.
+#define PACER_BUCKET_USEC 50
+#define PACER_LINEAR_BUCKETS 8
+#define PACER_OCTAVE_BUCKETS 4
+#define PACER_BUCKETS 64
+// Overshoot samples between halvings of the histogram
+#define PACER_DECAY 256
+// Overshoot percentile kept as the margin
+#define PACER_PERCENTILE 0.99
+// Margin before any sleep was measured
+#define PACER_INITIAL_MARGIN_USEC 2000
+// Shorter sleeps are not worth the wakeup
+#define PACER_MIN_SLEEP_USEC 200
+
+struct Pacer {
+  // Sleep at all, otherwise spin the whole wait
+  bool sleep;
+  // Usec left before the deadline when sleeping stops
+  uint64_t margin_usec;
+  uint32_t overshoot[PACER_BUCKETS];
+  uint64_t overshoot_samples;
+  // |frame delta - frame goal|, the last bucket counts everything beyond
+  uint32_t deviation[PACER_BUCKETS];
+  uint64_t frames;
+  uint64_t previous_sync_tsc;
+  uint64_t sleep_usec;
+  uint64_t spin_usec;
+};
+
+namespace platform
+{
+void
+pacer_init(bool sleep, Pacer* pacer)
+{
+  *pacer = Pacer{};
+  pacer->sleep = sleep;
+  pacer->margin_usec = PACER_INITIAL_MARGIN_USEC;
+}
+
+// Lower bound (usec) of histogram bucket i
+uint64_t
+pacer_bucket_usec(int i)
+{
+  if (i < PACER_LINEAR_BUCKETS) return i * PACER_BUCKET_USEC;
+  int octave = (i - PACER_LINEAR_BUCKETS) / PACER_OCTAVE_BUCKETS;
+  int step = (i - PACER_LINEAR_BUCKETS) % PACER_OCTAVE_BUCKETS;
+  uint64_t linear_usec = PACER_LINEAR_BUCKETS * PACER_BUCKET_USEC;
+  uint64_t base = linear_usec << octave;
+  return base + step * (base / PACER_OCTAVE_BUCKETS);
+}
+
+// Upper bound (usec) of the bucket holding percentile p of histogram, the
+// lower bound when that is the last bucket
+uint64_t
+pacer_percentile(const uint32_t* histogram, double p)
+{
+  uint64_t total = 0;
+  for (int i = 0; i < PACER_BUCKETS; ++i) total += histogram[i];
+  if (!total) return 0;
+
+  uint64_t rank = (uint64_t)(p * total);
+  uint64_t seen = 0;
+  for (int i = 0; i < PACER_BUCKETS - 1; ++i) {
+    seen += histogram[i];
+    if (seen > rank) return pacer_bucket_usec(i + 1);
+  }
+  return pacer_bucket_usec(PACER_BUCKETS - 1);
+}
+
+void
+pacer_record(uint32_t* histogram, uint64_t usec)
+{
+  uint64_t linear_usec = PACER_LINEAR_BUCKETS * PACER_BUCKET_USEC;
+  uint64_t bucket;
+  if (usec < linear_usec) {
+    bucket = usec / PACER_BUCKET_USEC;
+  } else {
+    uint64_t octave = 63 - LZCNT(usec / linear_usec);
+    uint64_t base = linear_usec << octave;
+    bucket = PACER_LINEAR_BUCKETS + octave * PACER_OCTAVE_BUCKETS +
+             (usec - base) / (base / PACER_OCTAVE_BUCKETS);
+  }
+  if (bucket >= PACER_BUCKETS) bucket = PACER_BUCKETS - 1;
+  histogram[bucket] += 1;
+}
+
+// True when the margin is in the last bucket, no sleep is requested
+bool
+pacer_spinning(const Pacer* pacer)
+{
+  return pacer->margin_usec >= pacer_bucket_usec(PACER_BUCKETS - 1);
+}
+
+void
+pacer_decay(Pacer* pacer)
+{
+  for (int i = 0; i < PACER_BUCKETS; ++i) pacer->overshoot[i] /= 2;
+  pacer->margin_usec = pacer_percentile(pacer->overshoot, PACER_PERCENTILE);
+  // Nothing left to go by
+  if (!pacer->margin_usec) pacer->margin_usec = PACER_INITIAL_MARGIN_USEC;
+}
+
+void
+pacer_overshoot(Pacer* pacer, uint64_t overshoot_usec)
+{
+  pacer->overshoot_samples += 1;
+  if (pacer->overshoot_samples % PACER_DECAY == 0) pacer_decay(pacer);
+  pacer_record(pacer->overshoot, overshoot_usec);
+  pacer->margin_usec = pacer_percentile(pacer->overshoot, PACER_PERCENTILE);
+}
+
+// Returns once clock_sync advanced the clock to the next frame
+void
+pacer_wait(Pacer* pacer, Clock_t* clock)
+{
+  uint64_t start = rdtsc();
+  uint64_t sleep_tsc = 0;
+  uint64_t remaining_usec;
+  while (!clock_sync(clock, &remaining_usec)) {
+    if (pacer->sleep && !pacer_spinning(pacer) &&
+        remaining_usec >= pacer->margin_usec + PACER_MIN_SLEEP_USEC) {
+      uint64_t request = remaining_usec - pacer->margin_usec;
+      uint64_t before = rdtsc();
+      sleep_usec(request);
+      uint64_t slept_tsc = rdtsc() - before;
+      uint64_t slept = tscdelta_to_usec(clock, slept_tsc);
+      pacer_overshoot(pacer, slept > request ? slept - request : 0);
+      sleep_tsc += slept_tsc;
+      continue;
+    }
+    _mm_pause();
+  }
+
+  uint64_t now = clock->frame_to_frame_tsc;
+  pacer->sleep_usec += tscdelta_to_usec(clock, sleep_tsc);
+  pacer->spin_usec += tscdelta_to_usec(clock, now - start - sleep_tsc);
+  if (pacer->frames) {
+    uint64_t delta = tscdelta_to_usec(clock, now - pacer->previous_sync_tsc);
+    uint64_t goal = tscdelta_to_usec(clock, clock->tsc_step);
+    pacer_record(pacer->deviation, delta > goal ? delta - goal : goal - delta);
+  }
+  pacer->previous_sync_tsc = now;
+  pacer->frames += 1;
+  // Spinning records no overshoot to decay with
+  if (pacer_spinning(pacer) && pacer->frames % PACER_DECAY == 0) {
+    pacer_decay(pacer);
+  }
+}
+
+void
+pacer_print(const Pacer* pacer)
+{
+  printf("[ %lu frames ] [ %lu us margin ] [ %lu us slept ] [ %lu us spun ]\n",
+         pacer->frames, pacer->margin_usec, pacer->sleep_usec,
+         pacer->spin_usec);
+  puts("frame deviation usec: frames");
+  for (int i = 0; i < PACER_BUCKETS; ++i) {
+    if (!pacer->deviation[i]) continue;
+    bool last = i == PACER_BUCKETS - 1;
+    printf("%s%4lu: %u\n", last ? ">=" : "< ",
+           pacer_bucket_usec(last ? i : i + 1), pacer->deviation[i]);
+  }
+}
+
+}  // namespace platform
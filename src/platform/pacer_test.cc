@@ -0,0 +1,125 @@
+#include <cassert>
+#include <cstdio>
+
+#include "platform.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+void
+Percentile()
+{
+  uint32_t histogram[PACER_BUCKETS] = {};
+  ASSERT_TRUE(platform::pacer_percentile(histogram, .99) == 0);
+  for (int i = 0; i < 98; ++i) platform::pacer_record(histogram, 10);
+  platform::pacer_record(histogram, 120);
+  platform::pacer_record(histogram, 1000000);
+  ASSERT_TRUE(platform::pacer_percentile(histogram, .5) == PACER_BUCKET_USEC);
+  ASSERT_TRUE(platform::pacer_percentile(histogram, .985) ==
+              3 * PACER_BUCKET_USEC);
+  ASSERT_TRUE(platform::pacer_percentile(histogram, .995) == 1024000);
+}
+
+// Linear buckets, then four per doubling
+void
+Buckets()
+{
+  ASSERT_TRUE(platform::pacer_bucket_usec(1) == PACER_BUCKET_USEC);
+  ASSERT_TRUE(platform::pacer_bucket_usec(8) == 400);
+  ASSERT_TRUE(platform::pacer_bucket_usec(9) == 500);
+  ASSERT_TRUE(platform::pacer_bucket_usec(12) == 800);
+  ASSERT_TRUE(platform::pacer_bucket_usec(13) == 1000);
+  for (int i = 0; i < PACER_BUCKETS; ++i) {
+    uint32_t histogram[PACER_BUCKETS] = {};
+    uint64_t usec = platform::pacer_bucket_usec(i);
+    platform::pacer_record(histogram, usec);
+    ASSERT_TRUE(histogram[i] == 1);
+    if (i + 1 == PACER_BUCKETS) break;
+    uint64_t next = platform::pacer_bucket_usec(i + 1);
+    ASSERT_TRUE(next > usec);
+    platform::pacer_record(histogram, next - 1);
+    ASSERT_TRUE(histogram[i] == 2);
+  }
+  ASSERT_TRUE(platform::pacer_bucket_usec(PACER_BUCKETS - 1) > 5000000);
+}
+
+// The margin follows the recent overshoot once older samples decay
+void
+MarginDecays()
+{
+  Pacer pacer;
+  platform::pacer_init(true, &pacer);
+  ASSERT_TRUE(pacer.margin_usec == PACER_INITIAL_MARGIN_USEC);
+  for (int i = 0; i < PACER_DECAY; ++i) platform::pacer_overshoot(&pacer, 900);
+  ASSERT_TRUE(pacer.margin_usec == 1000);
+  for (int i = 0; i < 8 * PACER_DECAY; ++i) {
+    platform::pacer_overshoot(&pacer, 60);
+  }
+  ASSERT_TRUE(pacer.margin_usec == 2 * PACER_BUCKET_USEC);
+}
+
+// Overshoot past the histogram stops sleeping until it decays away
+void
+SpinFallback()
+{
+  const uint64_t kFrameUsec = 1000;
+  Clock_t clock;
+  Pacer pacer;
+  platform::clock_init(kFrameUsec, &clock);
+  platform::pacer_init(true, &pacer);
+  for (int i = 0; i < 100; ++i) platform::pacer_overshoot(&pacer, 100);
+  platform::pacer_overshoot(&pacer, 10000000);
+  platform::pacer_overshoot(&pacer, 10000000);
+  ASSERT_TRUE(platform::pacer_spinning(&pacer));
+
+  // The outliers outlast the first halving
+  uint64_t samples = pacer.overshoot_samples;
+  for (int i = 0; i < 2 * PACER_DECAY - 1; ++i) {
+    platform::pacer_wait(&pacer, &clock);
+  }
+  ASSERT_TRUE(platform::pacer_spinning(&pacer));
+  ASSERT_TRUE(pacer.overshoot_samples == samples && !pacer.sleep_usec);
+  platform::pacer_wait(&pacer, &clock);
+  ASSERT_TRUE(!platform::pacer_spinning(&pacer));
+  ASSERT_TRUE(pacer.margin_usec == 3 * PACER_BUCKET_USEC);
+}
+
+void
+Run(bool sleep)
+{
+  const uint64_t kFrameUsec = 4000;
+  const uint64_t kFrames = 100;
+  Clock_t clock;
+  Pacer pacer;
+  platform::clock_init(kFrameUsec, &clock);
+  platform::pacer_init(sleep, &pacer);
+  for (uint64_t i = 0; i < kFrames; ++i) {
+    platform::pacer_wait(&pacer, &clock);
+  }
+
+  uint64_t counted = 0;
+  for (int i = 0; i < PACER_BUCKETS; ++i) counted += pacer.deviation[i];
+  ASSERT_TRUE(counted == kFrames - 1);
+  ASSERT_TRUE(pacer.frames == kFrames);
+  if (sleep) {
+    ASSERT_TRUE(pacer.overshoot_samples);
+    ASSERT_TRUE(pacer.sleep_usec);
+  } else {
+    ASSERT_TRUE(!pacer.sleep_usec);
+  }
+  printf("%s: p50 %lu us p99 %lu us jerk %lu\n", sleep ? "sleep" : "spin",
+         platform::pacer_percentile(pacer.deviation, .5),
+         platform::pacer_percentile(pacer.deviation, .99), clock.jerk);
+  platform::pacer_print(&pacer);
+}
+
+int
+main()
+{
+  Percentile();
+  Buckets();
+  MarginDecays();
+  SpinFallback();
+  Run(false);
+  Run(true);
+  return 0;
+}
@@ -14,13 +14,20 @@
 #include "window.cc"
 
 #if _WIN32
+#include "win32_event.cc"
 #include "win32_filesystem.cc"
+#include "win32_memory.cc"
 #include "win32_sleep.cc"
 #include "win32_thread.cc"
 #include "win32_udp.cc"
 #else
+#include "unix_event.cc"
 #include "unix_filesystem.cc"
+#include "unix_memory.cc"
 #include "unix_sleep.cc"
 #include "unix_thread.cc"
 #include "unix_udp.cc"
 #endif
+
+#include "arena.cc"
+#include "pacer.cc"
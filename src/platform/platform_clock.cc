@@ -1,10 +1,13 @@
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
 
 #include "macro.h"
 #include "rdtsc.h"
+#include "x64_intrin.h"
 
 struct Clock_t {
   // Conversion constants
@@ -20,7 +23,6 @@ struct Clock_t {
   uint64_t frame_to_frame_tsc;
 };
 
-#define USEC_PER_CLOCK (1000.f / 1000.f / CLOCKS_PER_SEC)
 #define CLOCKS_PER_MS (CLOCKS_PER_SEC / 1000)
 
 int
@@ -35,8 +37,55 @@ cmp(const void *lhs, const void *rhs)
 
 namespace platform
 {
-void
-clock_init(uint64_t frame_goal_usec, Clock_t *out_clock)
+// TSC ticks per second, 0 until the first clock_init
+static std::atomic<uint64_t> kTscHz;
+
+// Crystal clock ratio (0x15), else the hypervisor's reported TSC rate, else
+// the nominal base frequency (0x16). 0 when the cpu reports none.
+uint64_t
+tsc_hz_cpuid()
+{
+  uint32_t reg[4];
+  CPUID(0x15, 0, reg);
+  uint32_t denominator = reg[0], numerator = reg[1], crystal_hz = reg[2];
+  if (denominator && numerator && crystal_hz) {
+    return (uint64_t)crystal_hz * numerator / denominator;
+  }
+
+  // Hypervisor present
+  CPUID(1, 0, reg);
+  if (reg[2] & (1u << 31)) {
+    CPUID(0x40000010, 0, reg);
+    if (reg[0]) return (uint64_t)reg[0] * 1000;
+  }
+
+  // The invariant TSC runs at the base frequency
+  CPUID(0x16, 0, reg);
+  uint32_t base_mhz = reg[0] & 0xffff;
+  if (base_mhz) return (uint64_t)base_mhz * 1000 * 1000;
+
+  return 0;
+}
+
+// Kernel calibrated TSC rate, 0 when not exposed
+uint64_t
+tsc_hz_sysfs()
+{
+#ifdef __linux__
+  FILE* f = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r");
+  if (!f) return 0;
+  unsigned long long khz = 0;
+  if (fscanf(f, "%llu", &khz) != 1) khz = 0;
+  fclose(f);
+  return khz * 1000;
+#else
+  return 0;
+#endif
+}
+
+// Median of spins against clock()
+uint64_t
+tsc_hz_sample()
 {
   clock_t c = clock();
   clock_t p;
@@ -44,7 +93,7 @@ clock_init(uint64_t frame_goal_usec, Clock_t *out_clock)
   uint64_t rp;
 
 #define MAX_SAMPLES 10
-  uint64_t tsc_per_usec[MAX_SAMPLES];
+  uint64_t tsc_hz[MAX_SAMPLES];
   for (int i = 0; i < MAX_SAMPLES; ++i) {
     p = c;
     rp = rc;
@@ -55,16 +104,36 @@ clock_init(uint64_t frame_goal_usec, Clock_t *out_clock)
     } while (c - p < CLOCKS_PER_MS);
     rc = rdtsc();
 
-    tsc_per_usec[i] = (rc - rp) * ((c - p) * USEC_PER_CLOCK);
+    tsc_hz[i] = (rc - rp) * CLOCKS_PER_SEC / (c - p);
   }
 
-  qsort(tsc_per_usec, MAX_SAMPLES, sizeof(tsc_per_usec[0]), cmp);
-  out_clock->median_tsc_per_usec = tsc_per_usec[MAX_SAMPLES / 2];
+  qsort(tsc_hz, MAX_SAMPLES, sizeof(tsc_hz[0]), cmp);
+  return tsc_hz[MAX_SAMPLES / 2];
+}
+
+// Measured once per process, later calls are free
+uint64_t
+tsc_hz()
+{
+  uint64_t hz = kTscHz.load(std::memory_order_relaxed);
+  if (hz) return hz;
+
+  hz = tsc_hz_sysfs();
+  if (!hz) hz = tsc_hz_cpuid();
+  if (!hz) hz = tsc_hz_sample();
+  kTscHz.store(hz, std::memory_order_relaxed);
+  return hz;
+}
+
+void
+clock_init(uint64_t frame_goal_usec, Clock_t *out_clock)
+{
+  uint64_t hz = tsc_hz();
+  out_clock->median_tsc_per_usec = hz / (1000 * 1000);
 
   // Calculate the step
-  out_clock->tsc_step = frame_goal_usec * out_clock->median_tsc_per_usec;
-  out_clock->median_usec_per_tsc =
-      ((uint64_t)1 << 33) / out_clock->median_tsc_per_usec;
+  out_clock->tsc_step = frame_goal_usec * hz / (1000 * 1000);
+  out_clock->median_usec_per_tsc = ((uint64_t)1 << 33) * (1000 * 1000) / hz;
   // Init to current time
   uint64_t now = rdtsc();
   out_clock->jerk = 0;
@@ -0,0 +1,50 @@
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+
+#include "platform.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+uint64_t
+MonotonicNsec()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 * 1000 * 1000ull + now.tv_nsec;
+}
+
+int
+main()
+{
+  printf("tsc_hz sysfs %lu cpuid %lu\n", platform::tsc_hz_sysfs(),
+         platform::tsc_hz_cpuid());
+
+  uint64_t start = MonotonicNsec();
+  Clock_t first;
+  platform::clock_init(1000, &first);
+  uint64_t first_nsec = MonotonicNsec() - start;
+
+  // Later clocks reuse the process-wide rate
+  start = MonotonicNsec();
+  Clock_t second;
+  platform::clock_init(16666, &second);
+  uint64_t second_nsec = MonotonicNsec() - start;
+  ASSERT_TRUE(second.median_usec_per_tsc == first.median_usec_per_tsc);
+  ASSERT_TRUE(second.median_tsc_per_usec == first.median_tsc_per_usec);
+  ASSERT_TRUE(second_nsec < 1000 * 1000);
+  printf("first clock_init %lu us, second %lu us, %lu tsc/usec\n",
+         first_nsec / 1000, second_nsec / 1000, first.median_tsc_per_usec);
+
+  // Agrees with the monotonic clock over 50ms
+  uint64_t tsc = rdtsc();
+  start = MonotonicNsec();
+  while (MonotonicNsec() - start < 50 * 1000 * 1000)
+    ;
+  uint64_t usec = platform::tscdelta_to_usec(&first, rdtsc() - tsc);
+  uint64_t expect = (MonotonicNsec() - start) / 1000;
+  printf("50ms: tsc %lu us monotonic %lu us\n", usec, expect);
+  ASSERT_TRUE(usec > expect * 97 / 100 && usec < expect * 103 / 100);
+
+  return 0;
+}
@@ -5,8 +5,11 @@
 #include <ws2tcpip.h>
 #endif
 
+#include <cstdint>
+
+// Per thread, shards send and receive concurrently
 extern "C" {
-extern int udp_errno;
+extern thread_local int udp_errno;
 }
 
 struct Udp4 {
@@ -20,3 +23,13 @@ struct Udp4 {
   char socket_address[16];
 };
 
+
+// Datagrams moved per batched syscall
+#define UDP_MAX_BATCH 64
+
+// One outgoing datagram of a SendToBatch
+struct UdpSend {
+  Udp4 peer;
+  const void* buffer;
+  uint16_t len;
+};
@@ -0,0 +1,216 @@
+#include "event.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include "macro.h"
+
+namespace platform
+{
+int
+event_add_source(EventLoop* loop, EventSourceKind kind, int fd, uint64_t token)
+{
+  if (loop->used_source >= MAX_EVENT_SOURCE) return -1;
+
+  int index = loop->used_source;
+#ifdef __linux__
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u32 = index;
+  if (epoll_ctl(loop->fd, EPOLL_CTL_ADD, fd, &ev) != 0) return -1;
+#endif
+  loop->source[index].kind = kind;
+  loop->source[index].token = token;
+  loop->source[index].fd = fd;
+  loop->used_source += 1;
+
+  return index;
+}
+
+#ifdef __linux__
+bool
+event_create(EventLoop* loop)
+{
+  *loop = EventLoop{};
+  loop->fd = epoll_create1(EPOLL_CLOEXEC);
+  return loop->fd != -1;
+}
+
+bool
+event_add_socket(EventLoop* loop, Udp4 location, uint64_t token)
+{
+  return event_add_source(loop, kEventSocket, location.socket, token) != -1;
+}
+
+bool
+event_add_timer(EventLoop* loop, uint64_t period_usec, uint64_t token)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd == -1) return false;
+
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = period_usec / (1000 * 1000);
+  spec.it_interval.tv_nsec = (period_usec % (1000 * 1000)) * 1000;
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(fd, 0, &spec, NULL) != 0 ||
+      event_add_source(loop, kEventTimer, fd, token) == -1) {
+    close(fd);
+    return false;
+  }
+
+  return true;
+}
+
+bool
+event_add_wakeup(EventLoop* loop, uint64_t token, EventWakeup* wakeup)
+{
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd == -1) return false;
+
+  int index = event_add_source(loop, kEventWakeup, fd, token);
+  if (index == -1) {
+    close(fd);
+    return false;
+  }
+
+  wakeup->loop = loop;
+  wakeup->source = index;
+  return true;
+}
+
+void
+event_signal(EventWakeup wakeup)
+{
+  uint64_t one = 1;
+  ssize_t ignored = write(wakeup.loop->source[wakeup.source].fd, &one,
+                          sizeof(one));
+  (void)ignored;
+}
+
+int
+event_wait(EventLoop* loop, int64_t timeout_usec, uint64_t* token,
+           int max_token)
+{
+  struct epoll_event ev[MAX_EVENT_SOURCE];
+  // Round up: waking early would spin on an unexpired deadline
+  int timeout_msec = timeout_usec < 0 ? -1 : (timeout_usec + 999) / 1000;
+  int count = epoll_wait(loop->fd, ev, MIN(max_token, MAX_EVENT_SOURCE),
+                         timeout_msec);
+  if (count < 0) return errno == EINTR ? 0 : -1;
+
+  for (int i = 0; i < count; ++i) {
+    EventSource* source = &loop->source[ev[i].data.u32];
+    // Timer expirations and wakeup counts are consumed to re-arm
+    if (source->kind != kEventSocket) {
+      uint64_t value;
+      ssize_t ignored = read(source->fd, &value, sizeof(value));
+      (void)ignored;
+    }
+    token[i] = source->token;
+  }
+
+  return count;
+}
+
+void
+event_destroy(EventLoop* loop)
+{
+  for (int i = 0; i < loop->used_source; ++i) {
+    if (loop->source[i].kind != kEventSocket) close(loop->source[i].fd);
+  }
+  close(loop->fd);
+  *loop = EventLoop{};
+}
+#else
+bool
+event_kevent(EventLoop* loop, uintptr_t ident, int16_t filter, uint16_t flags,
+             uint32_t fflags, intptr_t data, int index)
+{
+  struct kevent ev;
+  EV_SET(&ev, ident, filter, flags, fflags, data, (void*)(intptr_t)index);
+  return kevent(loop->fd, &ev, 1, NULL, 0, NULL) == 0;
+}
+
+bool
+event_create(EventLoop* loop)
+{
+  *loop = EventLoop{};
+  loop->fd = kqueue();
+  return loop->fd != -1;
+}
+
+bool
+event_add_socket(EventLoop* loop, Udp4 location, uint64_t token)
+{
+  int index = event_add_source(loop, kEventSocket, location.socket, token);
+  if (index == -1) return false;
+  return event_kevent(loop, location.socket, EVFILT_READ, EV_ADD, 0, 0, index);
+}
+
+bool
+event_add_timer(EventLoop* loop, uint64_t period_usec, uint64_t token)
+{
+  int index = event_add_source(loop, kEventTimer, -1, token);
+  if (index == -1) return false;
+  return event_kevent(loop, index, EVFILT_TIMER, EV_ADD, NOTE_USECONDS,
+                      period_usec, index);
+}
+
+bool
+event_add_wakeup(EventLoop* loop, uint64_t token, EventWakeup* wakeup)
+{
+  int index = event_add_source(loop, kEventWakeup, -1, token);
+  if (index == -1) return false;
+  if (!event_kevent(loop, index, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, index))
+    return false;
+
+  wakeup->loop = loop;
+  wakeup->source = index;
+  return true;
+}
+
+void
+event_signal(EventWakeup wakeup)
+{
+  event_kevent(wakeup.loop, wakeup.source, EVFILT_USER, 0, NOTE_TRIGGER, 0,
+               wakeup.source);
+}
+
+int
+event_wait(EventLoop* loop, int64_t timeout_usec, uint64_t* token,
+           int max_token)
+{
+  struct kevent ev[MAX_EVENT_SOURCE];
+  struct timespec timeout;
+  timeout.tv_sec = timeout_usec / (1000 * 1000);
+  timeout.tv_nsec = (timeout_usec % (1000 * 1000)) * 1000;
+  int count = kevent(loop->fd, NULL, 0, ev, MIN(max_token, MAX_EVENT_SOURCE),
+                     timeout_usec < 0 ? NULL : &timeout);
+  if (count < 0) return errno == EINTR ? 0 : -1;
+
+  for (int i = 0; i < count; ++i) {
+    token[i] = loop->source[(intptr_t)ev[i].udata].token;
+  }
+
+  return count;
+}
+
+void
+event_destroy(EventLoop* loop)
+{
+  close(loop->fd);
+  *loop = EventLoop{};
+}
+#endif
+
+}  // namespace platform
@@ -0,0 +1,33 @@
+#include "memory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace platform
+{
+uint64_t
+memory_page_size()
+{
+  return sysconf(_SC_PAGESIZE);
+}
+
+void*
+memory_reserve(uint64_t bytes)
+{
+  void* ptr = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+bool
+memory_commit(void* ptr, uint64_t bytes)
+{
+  return mprotect(ptr, bytes, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+memory_release(void* ptr, uint64_t bytes)
+{
+  munmap(ptr, bytes);
+}
+
+}  // namespace platform
@@ -3,13 +3,14 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 
 #include "udp.h"
 
 extern "C" {
-int udp_errno;
+thread_local int udp_errno;
 }
 
 static_assert(sizeof(Udp4::socket_address) >= sizeof(struct sockaddr_in),
@@ -131,6 +132,116 @@ ReceiveAny(Udp4 location, uint16_t buffer_len, uint8_t* buffer,
   return true;
 }
 
+// Receives up to max_count datagrams with one syscall where supported.
+// Datagram i is written at buffer + i * buffer_len.
+bool
+ReceiveAnyBatch(Udp4 location, uint16_t buffer_len, uint8_t* buffer,
+                int max_count, uint16_t* bytes_received, Udp4* from_peer,
+                int* count)
+{
+  *count = 0;
+#ifdef __linux__
+  struct mmsghdr msg[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+  struct sockaddr_in remote_addr[UDP_MAX_BATCH];
+  int n = std::min(max_count, UDP_MAX_BATCH);
+  for (int i = 0; i < n; ++i) {
+    iov[i].iov_base = buffer + i * buffer_len;
+    iov[i].iov_len = buffer_len;
+    msg[i].msg_hdr = {};
+    msg[i].msg_hdr.msg_name = &remote_addr[i];
+    // MUST initialize: msg_namelen is an in/out parameter
+    msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    msg[i].msg_hdr.msg_iov = &iov[i];
+    msg[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int received = recvmmsg(location.socket, msg, n, MSG_DONTWAIT, NULL);
+  if (received < 0) {
+    udp_errno = (errno == EAGAIN) ? 0 : errno;
+    return false;
+  }
+
+  udp_errno = 0;
+  for (int i = 0; i < received; ++i) {
+    if (msg[i].msg_hdr.msg_namelen != sizeof(struct sockaddr_in)) continue;
+    int j = *count;
+    if (j != i) memmove(buffer + j * buffer_len, buffer + i * buffer_len,
+                        msg[i].msg_len);
+    bytes_received[j] = msg[i].msg_len;
+    from_peer[j].socket = -1;
+    memcpy(from_peer[j].socket_address, &remote_addr[i],
+           sizeof(struct sockaddr_in));
+    *count = j + 1;
+  }
+#else
+  for (int i = 0; i < max_count; ++i) {
+    int j = *count;
+    if (!ReceiveAny(location, buffer_len, buffer + j * buffer_len,
+                    &bytes_received[j], &from_peer[j]))
+      break;
+    *count = j + 1;
+  }
+#endif
+
+  return *count > 0;
+}
+
+// Sends every datagram in order with as few syscalls as possible. A
+// datagram the kernel refuses, such as one to a bad peer address, is
+// skipped so that it costs no other peer its datagrams; sending stops
+// only when the socket buffer is full. sent counts the datagrams handed
+// to the kernel or skipped. Returns true when all count were sent.
+bool
+SendToBatch(Udp4 location, const UdpSend* send, int count, int* sent)
+{
+  bool all = true;
+  *sent = 0;
+#ifdef __linux__
+  struct mmsghdr msg[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+  while (*sent < count) {
+    int n = std::min(count - *sent, UDP_MAX_BATCH);
+    for (int i = 0; i < n; ++i) {
+      const UdpSend* s = &send[*sent + i];
+      iov[i].iov_base = (void*)s->buffer;
+      iov[i].iov_len = s->len;
+      msg[i].msg_hdr = {};
+      msg[i].msg_hdr.msg_name = (void*)s->peer.socket_address;
+      msg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      msg[i].msg_hdr.msg_iov = &iov[i];
+      msg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // On error nothing was sent and errno belongs to the first datagram
+    int result = sendmmsg(location.socket, msg, n, MSG_DONTWAIT);
+    if (result < 0) {
+      if (errno == EAGAIN) {
+        udp_errno = 0;
+        return false;
+      }
+      udp_errno = errno;
+      all = false;
+      result = 1;
+    }
+    *sent += result;
+  }
+#else
+  for (; *sent < count; ++*sent) {
+    const UdpSend* s = &send[*sent];
+    if (SendTo(location, s->peer, s->buffer, s->len)) continue;
+    if (errno == EAGAIN) {
+      udp_errno = 0;
+      return false;
+    }
+    udp_errno = errno;
+    all = false;
+  }
+#endif
+
+  return all;
+}
+
 bool
 GetAddr4(const char* host, const char* service_or_port, Udp4* out)
 {
@@ -0,0 +1,167 @@
+#include "event.h"
+
+#include <windows.h>
+
+#include <algorithm>
+
+// Sockets signal an event through WSAEventSelect and wakeups are auto-reset
+// events, both waited on with WSAWaitForMultipleEvents. Timers are deadlines
+// that bound the wait.
+
+namespace platform
+{
+int
+event_add_source(EventLoop* loop, EventSourceKind kind, uint64_t token)
+{
+  if (loop->used_source >= MAX_EVENT_SOURCE) return -1;
+
+  int index = loop->used_source;
+  loop->source[index] = EventSource{};
+  loop->source[index].kind = kind;
+  loop->source[index].token = token;
+  loop->used_source += 1;
+
+  return index;
+}
+
+bool
+event_create(EventLoop* loop)
+{
+  *loop = EventLoop{};
+  return true;
+}
+
+void
+event_destroy(EventLoop* loop)
+{
+  for (int i = 0; i < loop->used_source; ++i) {
+    if (loop->source[i].event) CloseHandle(loop->source[i].event);
+  }
+  *loop = EventLoop{};
+}
+
+bool
+event_add_socket(EventLoop* loop, Udp4 location, uint64_t token)
+{
+  WSAEVENT event = WSACreateEvent();
+  if (event == WSA_INVALID_EVENT) return false;
+  if (WSAEventSelect(location.socket, event, FD_READ) == SOCKET_ERROR) {
+    WSACloseEvent(event);
+    return false;
+  }
+
+  int index = event_add_source(loop, kEventSocket, token);
+  if (index == -1) {
+    WSAEventSelect(location.socket, NULL, 0);
+    WSACloseEvent(event);
+    return false;
+  }
+  loop->source[index].socket = location.socket;
+  loop->source[index].event = event;
+  return true;
+}
+
+bool
+event_add_timer(EventLoop* loop, uint64_t period_usec, uint64_t token)
+{
+  int index = event_add_source(loop, kEventTimer, token);
+  if (index == -1) return false;
+  uint64_t period_msec = period_usec / 1000;
+  loop->source[index].period_msec = period_msec ? period_msec : 1;
+  loop->source[index].deadline_msec =
+      GetTickCount64() + loop->source[index].period_msec;
+  return true;
+}
+
+bool
+event_add_wakeup(EventLoop* loop, uint64_t token, EventWakeup* wakeup)
+{
+  HANDLE event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!event) return false;
+
+  int index = event_add_source(loop, kEventWakeup, token);
+  if (index == -1) {
+    CloseHandle(event);
+    return false;
+  }
+  loop->source[index].event = event;
+  wakeup->loop = loop;
+  wakeup->source = index;
+  return true;
+}
+
+void
+event_signal(EventWakeup wakeup)
+{
+  SetEvent(wakeup.loop->source[wakeup.source].event);
+}
+
+int
+event_wait(EventLoop* loop, int64_t timeout_usec, uint64_t* token,
+           int max_token)
+{
+  uint64_t start_msec = GetTickCount64();
+  while (1) {
+    int count = 0;
+    uint64_t now_msec = GetTickCount64();
+    int64_t wait_msec = timeout_usec < 0 ? INT32_MAX : timeout_usec / 1000;
+    wait_msec -= now_msec - start_msec;
+
+    WSAEVENT event[MAX_EVENT_SOURCE];
+    int event_source[MAX_EVENT_SOURCE];
+    DWORD event_count = 0;
+    for (int i = 0; i < loop->used_source; ++i) {
+      EventSource* source = &loop->source[i];
+      switch (source->kind) {
+        case kEventSocket:
+          event_source[event_count] = i;
+          event[event_count++] = source->event;
+          // Manual reset: clear before reporting, the caller drains
+          if (count < max_token &&
+              WaitForSingleObject(source->event, 0) == WAIT_OBJECT_0) {
+            WSAResetEvent(source->event);
+            token[count++] = source->token;
+          }
+          break;
+        case kEventTimer:
+          if (now_msec >= source->deadline_msec && count < max_token) {
+            source->deadline_msec = now_msec + source->period_msec;
+            token[count++] = source->token;
+          }
+          wait_msec = std::min(wait_msec,
+                               (int64_t)(source->deadline_msec - now_msec));
+          break;
+        case kEventWakeup:
+          event_source[event_count] = i;
+          event[event_count++] = source->event;
+          // Auto reset: a successful test consumes the signal
+          if (count < max_token &&
+              WaitForSingleObject(source->event, 0) == WAIT_OBJECT_0)
+            token[count++] = source->token;
+          break;
+      }
+    }
+    if (count) return count;
+    if (wait_msec < 0) return 0;
+
+    if (event_count == 0) {
+      Sleep(wait_msec);
+    } else {
+      DWORD result = WSAWaitForMultipleEvents(event_count, event, FALSE,
+                                              (DWORD)wait_msec, FALSE);
+      if (result == WSA_WAIT_FAILED) return -1;
+      // Returning for an auto-reset wakeup consumed its signal
+      DWORD ready = result - WSA_WAIT_EVENT_0;
+      if (ready < event_count && max_token > 0) {
+        EventSource* source = &loop->source[event_source[ready]];
+        if (source->kind == kEventWakeup) {
+          token[0] = source->token;
+          return 1;
+        }
+      }
+    }
+    if (wait_msec == 0 && timeout_usec >= 0) return 0;
+  }
+}
+
+}  // namespace platform
@@ -0,0 +1,31 @@
+#include "memory.h"
+
+namespace platform
+{
+uint64_t
+memory_page_size()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+}
+
+void*
+memory_reserve(uint64_t bytes)
+{
+  return VirtualAlloc(NULL, bytes, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool
+memory_commit(void* ptr, uint64_t bytes)
+{
+  return VirtualAlloc(ptr, bytes, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+void
+memory_release(void* ptr, uint64_t bytes)
+{
+  VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+}  // namespace platform
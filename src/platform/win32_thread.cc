@@ -1,23 +1,12 @@
 #include "thread.h"
 
-// TODO: This only works for a single thread. The API is hard
-// to make consistent with pthread for the following reasons -
-//
-// CreateThread returns a Handle to a thread. This is a win32
-// specific object. The thread API assumes an id that the
-// user can pick.
+// ThreadInfo::id holds the HANDLE returned by CreateThread, so any number
+// of threads may be created and joined.
 //
 // The functor returns a DWORD and not a void*.
 
 namespace platform {
 
-struct Thread {
-  HANDLE handle;
-  DWORD thread_id;
-};
-
-static Thread kThread;
-
 DWORD WINAPI Win32ThreadFunc( LPVOID lpParam )
 {
 	ThreadInfo* ti = (ThreadInfo*)lpParam;
@@ -31,15 +20,17 @@ thread_create(ThreadInfo* t)
 {
   if (t->id) return false;
 
-  kThread.handle = CreateThread(
+  DWORD thread_id;
+  HANDLE handle = CreateThread(
       NULL,
       0/* Default stack size */,
       Win32ThreadFunc,
       t,
       0,
-      &kThread.thread_id);
+      &thread_id);
+  if (!handle) return false;
 
-  t->id = kThread.thread_id;
+  t->id = (uint64_t)handle;
 
   return true;
 }
@@ -47,14 +38,19 @@ thread_create(ThreadInfo* t)
 void
 thread_yield()
 {
+  SwitchToThread();
 }
 
 bool
 thread_join(ThreadInfo* t)
 {
-  WaitForSingleObject(kThread.handle, INFINITE);
-  GetExitCodeThread(kThread.handle, (LPDWORD)&t->return_value);
-  return 0;
+  if (!t->id) return false;
+
+  HANDLE handle = (HANDLE)t->id;
+  WaitForSingleObject(handle, INFINITE);
+  CloseHandle(handle);
+  t->id = 0;
+  return true;
 }
 
 void
@@ -5,7 +5,7 @@
 #pragma comment(lib, "ws2_32.lib")
 
 extern "C" {
-int udp_errno;
+thread_local int udp_errno;
 }
 
 static_assert(sizeof(Udp4::socket_address) >= sizeof(struct sockaddr_in),
@@ -103,6 +103,45 @@ ReceiveAny(Udp4 location, uint16_t buffer_len, uint8_t* buffer,
   return true;
 }
 
+// Winsock has no batched datagram syscalls, loop the single calls.
+bool
+ReceiveAnyBatch(Udp4 location, uint16_t buffer_len, uint8_t* buffer,
+                int max_count, uint16_t* bytes_received, Udp4* from_peer,
+                int* count)
+{
+  *count = 0;
+  for (int i = 0; i < max_count; ++i) {
+    int j = *count;
+    if (!ReceiveAny(location, buffer_len, buffer + j * buffer_len,
+                    &bytes_received[j], &from_peer[j]))
+      break;
+    *count = j + 1;
+  }
+
+  return *count > 0;
+}
+
+// A datagram the kernel refuses is skipped, sending stops only when the
+// socket buffer is full. See unix_udp.cc.
+bool
+SendToBatch(Udp4 location, const UdpSend* send, int count, int* sent)
+{
+  bool all = true;
+  for (*sent = 0; *sent < count; ++*sent) {
+    const UdpSend* s = &send[*sent];
+    if (SendTo(location, s->peer, s->buffer, s->len)) continue;
+    int error = WSAGetLastError();
+    if (error == WSAEWOULDBLOCK) {
+      udp_errno = 0;
+      return false;
+    }
+    udp_errno = error;
+    all = false;
+  }
+
+  return all;
+}
+
 bool
 GetAddr4(const char* host, const char* service_or_port, Udp4* out)
 {
@@ -6,6 +6,7 @@
 #ifdef _WIN32
 #include <intrin.h>
 #else
+#include <cpuid.h>
 #include <x86intrin.h>
 #include <immintrin.h>
 #include <ammintrin.h>
@@ -19,6 +20,23 @@
 #define TARGET(x) __attribute__((target(x)))
 #endif
 
+// eax, ebx, ecx, edx of cpuid leaf/subleaf, zeros past the highest leaf
+inline void
+CPUID(uint32_t leaf, uint32_t subleaf, uint32_t reg[4])
+{
+#ifdef _WIN32
+  int max[4];
+  __cpuid(max, leaf & 0xC0000000);
+  reg[0] = reg[1] = reg[2] = reg[3] = 0;
+  if (leaf > (uint32_t)max[0]) return;
+  __cpuidex((int*)reg, leaf, subleaf);
+#else
+  reg[0] = reg[1] = reg[2] = reg[3] = 0;
+  if (leaf > __get_cpuid_max(leaf & 0xC0000000, nullptr)) return;
+  __cpuid_count(leaf, subleaf, reg[0], reg[1], reg[2], reg[3]);
+#endif
+}
+
 // Reset lowest set bit to 0
 inline uint64_t TARGET("bmi") BLSR(uint64_t f) { return _blsr_u64(f); }
 
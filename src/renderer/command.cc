@@ -0,0 +1,323 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "math/math.cc"
+#include "math/rect.h"
+
+// Draws recorded as POD commands with a 64-bit sort key, sorted to group
+// equal state and run by a backend. Recording and sorting make no GL
+// calls; ExecuteGL (renderer.cc) draws, ExecuteNull only walks the stream.
+//
+// Key layout, most significant first:
+//    63..56 depth - draw order, lower first. Shapes at equal z rely on it,
+//                   the depth test rejects later fragments at equal depth.
+//    55     blend - alpha blended or smoothed lines, after opaque of the
+//                   same depth
+//    54..48 program - RenderProgram
+//    47..32 vao - batch of an instance command, 0 otherwise
+//    31..0  unused
+// The sort is stable, so commands of equal key keep submission order.
+
+#define MAX_RENDER_COMMAND 8192
+#define MAX_RENDER_GRID 16
+#define MAX_RENDER_TEXT 64
+// Instances of a batch drawn by one call, longer runs take several
+#define MAX_BATCH_INSTANCE 1024
+
+namespace rgg
+{
+enum RenderProgram : uint64_t {
+  kProgramText,
+  kProgramInstance,
+  kProgramGrid,
+};
+
+enum RenderCommandType : uint32_t {
+  kCommandInstance,
+  kCommandGrid,
+  kCommandText,
+};
+
+// Per-instance vertex data of kInstanceVertexShader
+struct Instance {
+  math::Mat4f model;
+  math::Vec4f color;
+};
+
+struct RenderGridData {
+  math::Vec2f grid;
+  math::Rectf bounds;
+  math::Vec4f color;
+};
+
+struct RenderTextData {
+  // Must stay valid until the buffer executed
+  const char* msg;
+  float x;
+  float y;
+  math::Vec4f color;
+};
+
+struct RenderCommand {
+  uint64_t key;
+  uint32_t type;
+  // Index into the buffer's array for type
+  uint32_t data;
+};
+
+struct RenderStats {
+  uint32_t commands;
+  // Draw calls issued, one per run of instances or text, one per grid
+  uint32_t draws;
+  uint32_t program_changes;
+  uint32_t vao_changes;
+  uint32_t blend_changes;
+};
+
+struct RenderCommandBuffer {
+  RenderCommand command[MAX_RENDER_COMMAND];
+  uint32_t command_count;
+  // Other half of the radix sort
+  RenderCommand scratch[MAX_RENDER_COMMAND];
+  Instance instance[MAX_RENDER_COMMAND];
+  uint32_t instance_count;
+  RenderGridData grid[MAX_RENDER_GRID];
+  uint32_t grid_count;
+  RenderTextData text[MAX_RENDER_TEXT];
+  uint32_t text_count;
+  // Written by the last backend to execute the buffer
+  RenderStats stats;
+};
+
+typedef void (*RenderBackend)(RenderCommandBuffer* buffer);
+
+#define RENDER_KEY_DEPTH_SHIFT 56
+#define RENDER_KEY_BLEND_SHIFT 55
+#define RENDER_KEY_PROGRAM_SHIFT 48
+#define RENDER_KEY_VAO_SHIFT 32
+
+uint64_t
+RenderKey(uint8_t depth, bool blend, RenderProgram program, uint16_t vao)
+{
+  return (uint64_t)depth << RENDER_KEY_DEPTH_SHIFT |
+         (uint64_t)blend << RENDER_KEY_BLEND_SHIFT |
+         (uint64_t)program << RENDER_KEY_PROGRAM_SHIFT |
+         (uint64_t)vao << RENDER_KEY_VAO_SHIFT;
+}
+
+bool
+RenderKeyBlend(uint64_t key)
+{
+  return (key >> RENDER_KEY_BLEND_SHIFT) & 1;
+}
+
+uint64_t
+RenderKeyProgram(uint64_t key)
+{
+  return (key >> RENDER_KEY_PROGRAM_SHIFT) & 0x7F;
+}
+
+uint16_t
+RenderKeyVAO(uint64_t key)
+{
+  return (key >> RENDER_KEY_VAO_SHIFT) & 0xFFFF;
+}
+
+// State that takes a draw of its own: everything but the unused bits
+uint64_t
+RenderKeyState(uint64_t key)
+{
+  return key >> RENDER_KEY_VAO_SHIFT;
+}
+
+void
+ResetCommands(RenderCommandBuffer* buffer)
+{
+  buffer->command_count = 0;
+  buffer->instance_count = 0;
+  buffer->grid_count = 0;
+  buffer->text_count = 0;
+}
+
+// Returns the command's data index, or -1 when the buffer is full
+int64_t
+PushCommand(RenderCommandBuffer* buffer, uint64_t key, RenderCommandType type,
+            uint32_t* data_count, uint32_t max_data)
+{
+  assert(buffer->command_count < MAX_RENDER_COMMAND && *data_count < max_data);
+  if (buffer->command_count >= MAX_RENDER_COMMAND) return -1;
+  if (*data_count >= max_data) return -1;
+  uint32_t data = (*data_count)++;
+  buffer->command[buffer->command_count++] = RenderCommand{key, type, data};
+  return data;
+}
+
+// Instance of the shape in batch, the model matrix is built here
+void
+CommandInstance(RenderCommandBuffer* buffer, uint8_t depth, uint16_t batch,
+                bool blend, const math::Vec3f& position,
+                const math::Vec3f& scale, const math::Quatf& orientation,
+                const math::Vec4f& color)
+{
+  uint64_t key = RenderKey(depth, blend, kProgramInstance, batch);
+  int64_t data = PushCommand(buffer, key, kCommandInstance,
+                             &buffer->instance_count, MAX_RENDER_COMMAND);
+  if (data < 0) return;
+  Instance* instance = &buffer->instance[data];
+  instance->model = math::CreateTranslationMatrix(position) *
+                    math::CreateScaleMatrix(scale) *
+                    math::CreateRotationMatrix(orientation);
+  instance->color = color;
+}
+
+// Smoothed lines blend their coverage, whatever the color
+void
+CommandGrid(RenderCommandBuffer* buffer, uint8_t depth, math::Vec2f grid,
+            math::Rectf bounds, const math::Vec4f& color)
+{
+  uint64_t key = RenderKey(depth, true, kProgramGrid, 0);
+  int64_t data = PushCommand(buffer, key, kCommandGrid, &buffer->grid_count,
+                             MAX_RENDER_GRID);
+  if (data < 0) return;
+  buffer->grid[data] = RenderGridData{grid, bounds, color};
+}
+
+// The font shader writes opaque texels
+void
+CommandText(RenderCommandBuffer* buffer, uint8_t depth, const char* msg,
+            float x, float y, const math::Vec4f& color)
+{
+  uint64_t key = RenderKey(depth, false, kProgramText, 0);
+  int64_t data = PushCommand(buffer, key, kCommandText, &buffer->text_count,
+                             MAX_RENDER_TEXT);
+  if (data < 0) return;
+  buffer->text[data] = RenderTextData{msg, x, y, color};
+}
+
+// Stable LSD radix sort on the key, a byte per pass. Passes where every
+// key has the same byte, such as the unused low bits, are skipped.
+void
+SortCommands(RenderCommandBuffer* buffer)
+{
+  uint32_t count = buffer->command_count;
+  RenderCommand* from = buffer->command;
+  RenderCommand* to = buffer->scratch;
+
+  uint32_t histogram[8][256] = {};
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t key = from[i].key;
+    for (int pass = 0; pass < 8; ++pass) {
+      histogram[pass][(key >> (pass * 8)) & 0xFF] += 1;
+    }
+  }
+
+  for (int pass = 0; pass < 8; ++pass) {
+    uint32_t* h = histogram[pass];
+    if (!count || h[(from[0].key >> (pass * 8)) & 0xFF] == count) continue;
+
+    uint32_t offset = 0;
+    for (int i = 0; i < 256; ++i) {
+      uint32_t n = h[i];
+      h[i] = offset;
+      offset += n;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      to[h[(from[i].key >> (pass * 8)) & 0xFF]++] = from[i];
+    }
+    RenderCommand* swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if (from != buffer->command) {
+    memcpy(buffer->command, from, count * sizeof(RenderCommand));
+  }
+}
+
+// What a backend does around one command of the sorted stream
+struct RenderStep {
+  // Blending switches to RenderKeyBlend of the command's key
+  bool blend_change;
+  // The run filled a batch, draw it before queueing this instance
+  bool flush;
+  // Last command of its run, draw the run after queueing it
+  bool run_end;
+};
+
+// Walk of a sorted stream shared by the backends, so ExecuteNull counts
+// exactly what ExecuteGL issues
+struct RenderWalk {
+  const RenderCommandBuffer* buffer;
+  RenderStats stats;
+  // Blending is enabled between frames
+  bool blend;
+  // Instances queued in the current run since its last draw
+  uint32_t run_instance;
+};
+
+void
+RenderWalkBegin(const RenderCommandBuffer* buffer, RenderWalk* walk)
+{
+  *walk = RenderWalk{};
+  walk->buffer = buffer;
+  walk->stats.commands = buffer->command_count;
+  walk->blend = true;
+}
+
+// Steps of command i, walked in order. Grids draw on their own, instance
+// and text runs draw at their end.
+RenderStep
+RenderWalkNext(RenderWalk* walk, uint32_t i)
+{
+  const RenderCommandBuffer* buffer = walk->buffer;
+  const RenderCommand* command = &buffer->command[i];
+  uint64_t key = command->key;
+  uint64_t previous = i ? buffer->command[i - 1].key : 0;
+  RenderStats* stats = &walk->stats;
+  RenderStep step = {};
+
+  if (RenderKeyBlend(key) != walk->blend) {
+    walk->blend = RenderKeyBlend(key);
+    step.blend_change = true;
+    stats->blend_changes += 1;
+  }
+  if (i == 0 || RenderKeyProgram(key) != RenderKeyProgram(previous)) {
+    stats->program_changes += 1;
+  }
+  if (i == 0 || RenderKeyVAO(key) != RenderKeyVAO(previous)) {
+    stats->vao_changes += 1;
+  }
+
+  if (command->type == kCommandInstance) {
+    if (walk->run_instance == MAX_BATCH_INSTANCE) {
+      step.flush = true;
+      stats->draws += 1;
+      walk->run_instance = 0;
+    }
+    walk->run_instance += 1;
+  }
+
+  step.run_end = i + 1 == buffer->command_count ||
+                 RenderKeyState(buffer->command[i + 1].key) !=
+                     RenderKeyState(key);
+  if (command->type == kCommandGrid || step.run_end) stats->draws += 1;
+  if (step.run_end) walk->run_instance = 0;
+  return step;
+}
+
+// Counts the draws and state changes of the sorted stream without drawing
+void
+ExecuteNull(RenderCommandBuffer* buffer)
+{
+  RenderWalk walk;
+  RenderWalkBegin(buffer, &walk);
+  for (uint32_t i = 0; i < buffer->command_count; ++i) {
+    RenderWalkNext(&walk, i);
+  }
+  buffer->stats = walk.stats;
+}
+
+}  // namespace rgg
@@ -0,0 +1,160 @@
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+
+#include "command.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+using namespace rgg;
+
+static RenderCommandBuffer kBuffer;
+
+const math::Quatf kIdentity(0.f, 0.f, 0.f, 1.f);
+const math::Vec4f kOpaque(1.f, 1.f, 1.f, 1.f);
+const math::Vec4f kBlended(1.f, 1.f, 1.f, .5f);
+
+void
+KeyOrder()
+{
+  ASSERT_TRUE(RenderKey(0, true, kProgramGrid, 9) <
+              RenderKey(1, false, kProgramText, 0));
+  ASSERT_TRUE(RenderKey(1, false, kProgramGrid, 9) <
+              RenderKey(1, true, kProgramText, 0));
+  ASSERT_TRUE(RenderKey(1, false, kProgramText, 9) <
+              RenderKey(1, false, kProgramInstance, 0));
+  uint64_t key = RenderKey(3, true, kProgramInstance, 7);
+  ASSERT_TRUE(RenderKeyBlend(key));
+  ASSERT_TRUE(RenderKeyProgram(key) == kProgramInstance);
+  ASSERT_TRUE(RenderKeyVAO(key) == 7);
+}
+
+// Keys over every byte, against a stable insertion sort
+void
+SortStable()
+{
+  uint64_t seed = 0x9E3779B97F4A7C15;
+  ResetCommands(&kBuffer);
+  for (uint32_t i = 0; i < 2000; ++i) {
+    seed = seed * 6364136223846793005 + 1442695040888963407;
+    // Few distinct keys so that many are equal
+    uint64_t key = (seed >> 59) << 40 | (seed >> 61);
+    kBuffer.command[kBuffer.command_count++] =
+        RenderCommand{key, kCommandInstance, i};
+  }
+
+  static RenderCommand expect[MAX_RENDER_COMMAND];
+  uint32_t count = kBuffer.command_count;
+  for (uint32_t i = 0; i < count; ++i) {
+    RenderCommand c = kBuffer.command[i];
+    uint32_t j = i;
+    while (j && expect[j - 1].key > c.key) {
+      expect[j] = expect[j - 1];
+      j -= 1;
+    }
+    expect[j] = c;
+  }
+
+  SortCommands(&kBuffer);
+  for (uint32_t i = 0; i < count; ++i) {
+    ASSERT_TRUE(kBuffer.command[i].key == expect[i].key);
+    ASSERT_TRUE(kBuffer.command[i].data == expect[i].data);
+  }
+}
+
+// Interleaved submission collapses to one draw per state
+void
+NullStats()
+{
+  ResetCommands(&kBuffer);
+  for (int i = 0; i < 10; ++i) {
+    CommandInstance(&kBuffer, 1, 0, false, math::Vec3f(i, 0.f, 0.f),
+                    math::Vec3f(1.f, 1.f, 1.f), kIdentity, kOpaque);
+    CommandInstance(&kBuffer, 1, 1, false, math::Vec3f(i, 0.f, 0.f),
+                    math::Vec3f(1.f, 1.f, 1.f), kIdentity, kOpaque);
+    CommandInstance(&kBuffer, 1, 0, true, math::Vec3f(i, 0.f, 0.f),
+                    math::Vec3f(1.f, 1.f, 1.f), kIdentity, kBlended);
+  }
+  CommandGrid(&kBuffer, 2, math::Vec2f(50.f, 50.f),
+              math::Rectf{math::Vec2f(0.f, 0.f), math::Vec2f(100.f, 100.f)},
+              kBlended);
+  CommandGrid(&kBuffer, 2, math::Vec2f(25.f, 25.f),
+              math::Rectf{math::Vec2f(0.f, 0.f), math::Vec2f(100.f, 100.f)},
+              kBlended);
+  CommandText(&kBuffer, 0, "a", 0.f, 0.f, kOpaque);
+  CommandText(&kBuffer, 0, "b", 0.f, 0.f, kOpaque);
+
+  ExecuteNull(&kBuffer);
+  ASSERT_TRUE(kBuffer.stats.commands == 34);
+  ASSERT_TRUE(kBuffer.stats.draws == 33);
+
+  SortCommands(&kBuffer);
+  ExecuteNull(&kBuffer);
+  ASSERT_TRUE(kBuffer.stats.commands == 34);
+  // Text, two instance batches, blended instances, two grids
+  ASSERT_TRUE(kBuffer.stats.draws == 6);
+  ASSERT_TRUE(kBuffer.stats.program_changes == 3);
+  ASSERT_TRUE(kBuffer.stats.vao_changes == 3);
+  ASSERT_TRUE(kBuffer.stats.blend_changes == 2);
+
+  // Submission order holds within a state
+  ASSERT_TRUE(kBuffer.command[0].type == kCommandText);
+  ASSERT_TRUE(kBuffer.text[kBuffer.command[0].data].msg[0] == 'a');
+  for (int i = 0; i < 10; ++i) {
+    Instance* instance = &kBuffer.instance[kBuffer.command[2 + i].data];
+    ASSERT_TRUE(instance->model[12] == i);
+  }
+  ASSERT_TRUE(kBuffer.grid[kBuffer.command[32].data].grid.x == 50.f);
+}
+
+// A run past MAX_BATCH_INSTANCE takes a draw per filled batch. Blending is
+// on already for a blended first command.
+void
+LongRun()
+{
+  ResetCommands(&kBuffer);
+  for (int i = 0; i < 2 * MAX_BATCH_INSTANCE + 1; ++i) {
+    CommandInstance(&kBuffer, 1, 0, true, math::Vec3f(i, 0.f, 0.f),
+                    math::Vec3f(1.f, 1.f, 1.f), kIdentity, kBlended);
+  }
+  SortCommands(&kBuffer);
+  ExecuteNull(&kBuffer);
+  ASSERT_TRUE(kBuffer.stats.draws == 3);
+  ASSERT_TRUE(kBuffer.stats.blend_changes == 0);
+  ASSERT_TRUE(kBuffer.stats.program_changes == 1);
+}
+
+void
+Benchmark()
+{
+  constexpr int kFrames = 200;
+  uint64_t draws = 0;
+  clock_t c = clock();
+  for (int f = 0; f < kFrames; ++f) {
+    ResetCommands(&kBuffer);
+    for (uint32_t i = 0; i < MAX_RENDER_COMMAND; ++i) {
+      CommandInstance(&kBuffer, i % 3, i % 5, i % 2, math::Vec3f(i, f, 0.f),
+                      math::Vec3f(1.f, 1.f, 1.f), kIdentity,
+                      i % 2 ? kBlended : kOpaque);
+    }
+    SortCommands(&kBuffer);
+    ExecuteNull(&kBuffer);
+    draws += kBuffer.stats.draws;
+  }
+  double ms = 1000.0 * (clock() - c) / CLOCKS_PER_SEC;
+  ASSERT_TRUE(draws == kFrames * 30);
+  printf("%d commands x %d frames: record, sort, null execute %.2f ms/frame\n",
+         MAX_RENDER_COMMAND, kFrames, ms / kFrames);
+}
+
+int
+main()
+{
+  KeyOrder();
+  SortStable();
+  NullStats();
+  LongRun();
+  Benchmark();
+  printf("command ok\n");
+  return 0;
+}
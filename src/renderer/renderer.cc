@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 
+#include "command.cc"
 #include "gl/gl.cc"
 #include "gl/shader.cc"
 #include "math/math.cc"
@@ -25,6 +26,38 @@ struct CircleProgram {
   GLuint radius_uniform;
 };
 
+struct GridProgram {
+  GLuint reference;
+  GLuint view_projection_uniform;
+  GLuint origin_uniform;
+  GLuint extent_uniform;
+  GLuint step_uniform;
+  GLuint horizontal_count_uniform;
+  GLuint color_uniform;
+};
+
+struct InstanceProgram {
+  GLuint reference;
+  GLuint view_projection_uniform;
+};
+
+// The rectangle and one per Tag
+#define MAX_BATCH 16
+
+static_assert(sizeof(Instance) == 20 * sizeof(GLfloat),
+              "Instance must match the vertex attribute layout");
+
+// Instances of one shape queued since the last flush
+struct Batch {
+  GLuint vao_reference;
+  // Streamed, orphaned on every flush
+  GLuint instance_vbo_reference;
+  GLuint vert_count;
+  GLenum mode;
+  uint32_t count;
+  Instance instance[MAX_BATCH_INSTANCE];
+};
+
 struct Observer {
   math::Mat4f projection;
   math::Mat4f view;
@@ -33,11 +66,19 @@ struct Observer {
 struct RGG {
   GeometryProgram geometry_program;
   CircleProgram circle_program;
+  InstanceProgram instance_program;
+  GridProgram grid_program;
 
   // References to vertex data on GPU.
   GLuint triangle_vao_reference;
   GLuint rectangle_vao_reference;
   GLuint line_vao_reference;
+  // No attributes, kGridVertexShader generates the vertices.
+  GLuint grid_vao_reference;
+
+  Batch batch[MAX_BATCH];
+  uint32_t batch_count;
+  uint32_t rectangle_batch;
 
   int meter_size = 50;
 };
@@ -118,6 +159,108 @@ SetupCircleProgram()
   return true;
 }
 
+bool
+SetupInstanceProgram()
+{
+  GLuint vert_shader, frag_shader;
+  if (!gl::CompileShader(GL_VERTEX_SHADER, &rgg::kInstanceVertexShader,
+                         &vert_shader)) {
+    return false;
+  }
+
+  if (!gl::CompileShader(GL_FRAGMENT_SHADER, &rgg::kFragmentShader,
+                         &frag_shader)) {
+    return false;
+  }
+
+  if (!gl::LinkShaders(&kRGG.instance_program.reference, 2, vert_shader,
+                       frag_shader)) {
+    return false;
+  }
+
+  // No use for the basic shaders after the program is linked.
+  glDeleteShader(vert_shader);
+  glDeleteShader(frag_shader);
+
+  kRGG.instance_program.view_projection_uniform = glGetUniformLocation(
+      kRGG.instance_program.reference, "view_projection");
+  assert(kRGG.instance_program.view_projection_uniform != uint32_t(-1));
+  return true;
+}
+
+bool
+SetupGridProgram()
+{
+  GLuint vert_shader, frag_shader;
+  if (!gl::CompileShader(GL_VERTEX_SHADER, &rgg::kGridVertexShader,
+                         &vert_shader)) {
+    return false;
+  }
+
+  if (!gl::CompileShader(GL_FRAGMENT_SHADER, &rgg::kFragmentShader,
+                         &frag_shader)) {
+    return false;
+  }
+
+  if (!gl::LinkShaders(&kRGG.grid_program.reference, 2, vert_shader,
+                       frag_shader)) {
+    return false;
+  }
+
+  // No use for the basic shaders after the program is linked.
+  glDeleteShader(vert_shader);
+  glDeleteShader(frag_shader);
+
+  GridProgram& grid = kRGG.grid_program;
+  grid.view_projection_uniform =
+      glGetUniformLocation(grid.reference, "view_projection");
+  assert(grid.view_projection_uniform != uint32_t(-1));
+  grid.origin_uniform = glGetUniformLocation(grid.reference, "origin");
+  assert(grid.origin_uniform != uint32_t(-1));
+  grid.extent_uniform = glGetUniformLocation(grid.reference, "extent");
+  assert(grid.extent_uniform != uint32_t(-1));
+  grid.step_uniform = glGetUniformLocation(grid.reference, "step");
+  assert(grid.step_uniform != uint32_t(-1));
+  grid.horizontal_count_uniform =
+      glGetUniformLocation(grid.reference, "horizontal_count");
+  assert(grid.horizontal_count_uniform != uint32_t(-1));
+  grid.color_uniform = glGetUniformLocation(grid.reference, "color");
+  assert(grid.color_uniform != uint32_t(-1));
+  return true;
+}
+
+// Returns the index of a new batch drawing vert_count vertices in mode per
+// instance
+uint32_t
+CreateBatch(int vert_count, GLfloat* verts, GLenum mode)
+{
+  assert(kRGG.batch_count < MAX_BATCH);
+  uint32_t index = kRGG.batch_count++;
+  Batch* batch = &kRGG.batch[index];
+  batch->vao_reference = gl::CreateGeometryVAO(vert_count * 3, verts);
+  batch->vert_count = vert_count;
+  batch->mode = mode;
+  batch->count = 0;
+
+  // CreateGeometryVAO left the vao bound, add the instance attributes.
+  glGenBuffers(1, &batch->instance_vbo_reference);
+  glBindBuffer(GL_ARRAY_BUFFER, batch->instance_vbo_reference);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(batch->instance), NULL,
+               GL_STREAM_DRAW);
+  for (int i = 0; i < 4; ++i) {
+    glEnableVertexAttribArray(1 + i);
+    glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          (void*)(offsetof(Instance, model) +
+                                  i * 4 * sizeof(GLfloat)));
+    glVertexAttribDivisor(1 + i, 1);
+  }
+  glEnableVertexAttribArray(5);
+  glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                        (void*)offsetof(Instance, color));
+  glVertexAttribDivisor(5, 1);
+  return index;
+}
+
 bool
 Initialize()
 {
@@ -134,6 +277,8 @@ Initialize()
   // Compile and link shaders.
   if (!SetupGeometryProgram()) return false;
   if (!SetupCircleProgram()) return false;
+  if (!SetupInstanceProgram()) return false;
+  if (!SetupGridProgram()) return false;
 
   // Create the geometry for basic shapes.
   float m = kRGG.meter_size;
@@ -153,12 +298,16 @@ Initialize()
       m / 2.f, -m / 2.f, 0.f
   };
   // clang-format on
-  kRGG.rectangle_vao_reference = gl::CreateGeometryVAO(18, square);
+  // The batch's instance attributes go unread by the geometry program
+  kRGG.rectangle_batch = CreateBatch(6, square, GL_TRIANGLES);
+  kRGG.rectangle_vao_reference = kRGG.batch[kRGG.rectangle_batch].vao_reference;
 
   // Line is flat on the x-axis with distance m.
   GLfloat line[6] = {-1.f, 0.f, 0.f, 1.f, 0.f, 0.f};
   kRGG.line_vao_reference = gl::CreateGeometryVAO(6, line);
 
+  glGenVertexArrays(1, &kRGG.grid_vao_reference);
+
   if (!SetupUI()) {
     printf("Failed to setup UI.\n");
     return false;
@@ -171,12 +320,62 @@ Tag
 CreateRenderable(int vert_count, GLfloat* verts, GLenum mode)
 {
   Tag tag = {};
-  tag.vao_reference = gl::CreateGeometryVAO(vert_count * 3, verts);
+  tag.batch = CreateBatch(vert_count, verts, mode);
+  tag.vao_reference = kRGG.batch[tag.batch].vao_reference;
   tag.vert_count = vert_count;
   tag.mode = mode;
   return tag;
 }
 
+// Draws the queued instances of batch with one call
+void
+FlushBatch(Batch* batch)
+{
+  if (!batch->count) return;
+  glUseProgram(kRGG.instance_program.reference);
+  math::Mat4f view_projection = kObserver.projection * kObserver.view;
+  glUniformMatrix4fv(kRGG.instance_program.view_projection_uniform, 1,
+                     GL_FALSE, &view_projection[0]);
+  glBindVertexArray(batch->vao_reference);
+  // Orphan the previous contents instead of waiting on draws reading them.
+  glBindBuffer(GL_ARRAY_BUFFER, batch->instance_vbo_reference);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(batch->instance), NULL,
+               GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, batch->count * sizeof(Instance),
+                  batch->instance);
+  glDrawArraysInstanced(batch->mode, 0, batch->vert_count, batch->count);
+  batch->count = 0;
+}
+
+void
+PushInstance(Batch* batch, const Instance& instance)
+{
+  assert(batch->count < MAX_BATCH_INSTANCE);
+  batch->instance[batch->count++] = instance;
+}
+
+// As RenderRectangle, recorded into buffer
+void
+CommandRectangle(RenderCommandBuffer* buffer, uint8_t depth,
+                 const math::Vec3f& position, const math::Vec3f& scale,
+                 const math::Quatf& orientation, const math::Vec4f& color)
+{
+  CommandInstance(buffer, depth, kRGG.rectangle_batch, color.w < 1.f,
+                  position, scale, orientation, color);
+}
+
+// As RenderTag, recorded into buffer. Smoothed lines blend their coverage.
+void
+CommandTag(RenderCommandBuffer* buffer, uint8_t depth, const Tag& tag,
+           const math::Vec3f& position, const math::Vec3f& scale,
+           const math::Quatf& orientation, const math::Vec4f& color)
+{
+  bool lines = tag.mode == GL_LINES || tag.mode == GL_LINE_LOOP ||
+               tag.mode == GL_LINE_STRIP;
+  CommandInstance(buffer, depth, tag.batch, color.w < 1.f || lines, position,
+                  scale, orientation, color);
+}
+
 void
 RenderTag(const Tag& tag, const math::Vec3f& position, const math::Vec3f& scale,
           const math::Quatf& orientation, const math::Vec4f& color)
@@ -286,39 +485,68 @@ RenderLine(const math::Vec3f& start, const math::Vec3f& end,
   glDrawArrays(GL_LINES, 0, 2);
 }
 
+// Lines every grid step from bounds.min, short of bounds.max, in one draw
 void
 RenderGrid(math::Vec2f grid, math::Rectf bounds, const math::Vec4f& color)
 {
-  // Prepare Geometry and color
-  glUseProgram(kRGG.geometry_program.reference);
-  glBindVertexArray(kRGG.line_vao_reference);
-  glUniform4f(kRGG.geometry_program.color_uniform, color.x, color.y, color.z,
-              color.w);
-
-  math::Vec2f& bottom_left = bounds.min;
-  math::Vec2f& top_right = bounds.max;
-
-  // Draw horizontal lines.
-  for (float y = bottom_left.y; y < top_right.y; y += grid.y) {
-    auto start = math::Vec3f(bottom_left.x, y, 0.f);
-    auto end = math::Vec3f(top_right.x, y, 0.f);
-    math::Mat4f matrix =
-        kObserver.projection * kObserver.view * CreateLineTransform(start, end);
-    glUniformMatrix4fv(kRGG.geometry_program.matrix_uniform, 1, GL_FALSE,
-                       &matrix[0]);
-    glDrawArrays(GL_LINES, 0, 2);
-  }
+  math::Vec2f size = bounds.max - bounds.min;
+  int horizontal_count = size.y > 0.f ? (int)ceilf(size.y / grid.y) : 0;
+  int vertical_count = size.x > 0.f ? (int)ceilf(size.x / grid.x) : 0;
+  if (!horizontal_count && !vertical_count) return;
+
+  const GridProgram& program = kRGG.grid_program;
+  glUseProgram(program.reference);
+  glBindVertexArray(kRGG.grid_vao_reference);
+  math::Mat4f view_projection = kObserver.projection * kObserver.view;
+  glUniformMatrix4fv(program.view_projection_uniform, 1, GL_FALSE,
+                     &view_projection[0]);
+  glUniform2f(program.origin_uniform, bounds.min.x, bounds.min.y);
+  glUniform2f(program.extent_uniform, bounds.max.x, bounds.max.y);
+  glUniform2f(program.step_uniform, grid.x, grid.y);
+  glUniform1i(program.horizontal_count_uniform, horizontal_count);
+  glUniform4f(program.color_uniform, color.x, color.y, color.z, color.w);
+  glDrawArrays(GL_LINES, 0, 2 * (horizontal_count + vertical_count));
+}
 
-  // Draw vertical lines.
-  for (float x = bottom_left.x; x < top_right.x; x += grid.x) {
-    auto start = math::Vec3f(x, bottom_left.y, 0.f);
-    auto end = math::Vec3f(x, top_right.y, 0.f);
-    math::Mat4f matrix =
-        kObserver.projection * kObserver.view * CreateLineTransform(start, end);
-    glUniformMatrix4fv(kRGG.geometry_program.matrix_uniform, 1, GL_FALSE,
-                       &matrix[0]);
-    glDrawArrays(GL_LINES, 0, 2);
+// Draws the sorted commands of buffer. Each run of equal key state is one
+// draw: instances through their batch, text through FlushText.
+void
+ExecuteGL(RenderCommandBuffer* buffer)
+{
+  RenderWalk walk;
+  RenderWalkBegin(buffer, &walk);
+  for (uint32_t i = 0; i < buffer->command_count; ++i) {
+    const RenderCommand* command = &buffer->command[i];
+    uint64_t key = command->key;
+    RenderStep step = RenderWalkNext(&walk, i);
+    if (step.blend_change) {
+      if (walk.blend) {
+        glEnable(GL_BLEND);
+      } else {
+        glDisable(GL_BLEND);
+      }
+    }
+
+    switch (command->type) {
+      case kCommandInstance: {
+        Batch* batch = &kRGG.batch[RenderKeyVAO(key)];
+        if (step.flush) FlushBatch(batch);
+        PushInstance(batch, buffer->instance[command->data]);
+        if (step.run_end) FlushBatch(batch);
+      } break;
+      case kCommandGrid: {
+        const RenderGridData* grid = &buffer->grid[command->data];
+        RenderGrid(grid->grid, grid->bounds, grid->color);
+      } break;
+      case kCommandText: {
+        const RenderTextData* text = &buffer->text[command->data];
+        BatchText(text->msg, text->x, text->y, text->color);
+        if (step.run_end) FlushText();
+      } break;
+    }
   }
+  if (!walk.blend) glEnable(GL_BLEND);
+  buffer->stats = walk.stats;
 }
 
 }  // namespace rgg
@@ -4,6 +4,12 @@
 
 #include "platform/platform.cc"
 
+// Address space of kFrameArena, committed as used
+#define FRAME_ARENA_BYTES (64 * 1024 * 1024)
+
+// Memory lives through the frame being rendered
+static Arena kFrameArena;
+
 // rgg for render go-go!
 
 namespace rgg {
@@ -13,6 +19,8 @@ struct Tag {
   GLuint vao_reference;
   GLuint vert_count;
   GLenum mode;
+  // Batch instancing the geometry, owns vao_reference
+  uint32_t batch;
 };
 
 bool Initialize();
@@ -23,6 +23,46 @@ inline constexpr const char* kFragmentShader = R"(
   }
 )";
 
+// Per-instance model (locations 1-4) and color, see rgg::Instance.
+inline constexpr const char* kInstanceVertexShader = R"(
+  #version 410
+  layout (location = 0) in vec3 vertex_position;
+  layout (location = 1) in mat4 model;
+  layout (location = 5) in vec4 color;
+  uniform mat4 view_projection;
+  out vec4 color_out;
+  void main() {
+    color_out = color;
+    gl_Position = view_projection * model * vec4(vertex_position, 1.0);
+  }
+)";
+
+// Grid lines from gl_VertexID, no vertex data. The first horizontal_count
+// lines run along x from origin.y upward, the rest along y from origin.x.
+inline constexpr const char* kGridVertexShader = R"(
+  #version 410
+  uniform mat4 view_projection;
+  uniform vec2 origin;
+  uniform vec2 extent;
+  uniform vec2 step;
+  uniform int horizontal_count;
+  uniform vec4 color;
+  out vec4 color_out;
+  void main() {
+    int line = gl_VertexID / 2;
+    bool start = (gl_VertexID % 2) == 0;
+    vec2 position;
+    if (line < horizontal_count) {
+      position = vec2(start ? origin.x : extent.x, origin.y + line * step.y);
+    } else {
+      line -= horizontal_count;
+      position = vec2(origin.x + line * step.x, start ? origin.y : extent.y);
+    }
+    color_out = color;
+    gl_Position = view_projection * vec4(position, 0.0, 1.0);
+  }
+)";
+
 inline constexpr const char* kCircleVertexShader = R"(
   #version 410
   layout (location = 0) in vec3 vertex_position;
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "platform/arena.cc"
+
 // http://tfc.duke.free.fr/coding/tga_specs.pdf
 struct FntMetadataRow {
   int id;
@@ -52,8 +54,9 @@ LoadFntMetadata(const char* file)
   return metadata;
 }
 
+// Reads the file into arena, *image_bytes points into it
 bool
-LoadTGA(const char* file, uint8_t** image_bytes,
+LoadTGA(const char* file, Arena* arena, uint8_t** image_bytes,
         uint16_t* image_width, uint16_t* image_height)
 {
 #pragma pack(push,1)
@@ -78,11 +81,17 @@ LoadTGA(const char* file, uint8_t** image_bytes,
   uint32_t file_length;
 
   fptr = fopen(file, "rb");
+  if (!fptr) return false;
   fseek(fptr, 0, SEEK_END);
   file_length = ftell(fptr);
   rewind(fptr);
-  buffer = (uint8_t*)malloc(file_length);
+  buffer = ArenaPushArray<uint8_t>(arena, file_length);
+  if (!buffer) {
+    fclose(fptr);
+    return false;
+  }
   fread(buffer, file_length, 1, fptr);
+  fclose(fptr);
 
   // First load the header.
   TgaHeader* header = (TgaHeader*)buffer;
@@ -98,10 +107,8 @@ LoadTGA(const char* file, uint8_t** image_bytes,
   uint32_t image_bytes_size = image_spec->image_width * image_spec->image_height;
   *image_width = image_spec->image_width;
   *image_height = image_spec->image_height;
-  *image_bytes = (uint8_t*)malloc(image_bytes_size);
-  memcpy(*image_bytes, &buffer[sizeof(TgaHeader) + sizeof(TgaImageSpec)], image_bytes_size);
-  // Free buffer used to read in file.
-  free(buffer);
-  fclose(fptr);
+  if (sizeof(TgaHeader) + sizeof(TgaImageSpec) + image_bytes_size > file_length)
+    return false;
+  *image_bytes = &buffer[sizeof(TgaHeader) + sizeof(TgaImageSpec)];
   return true;
 }
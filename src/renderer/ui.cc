@@ -1,5 +1,6 @@
 #include "ui.h"
 
+#include "common/hash.cc"
 #include "gl/shader.h"
 #include "math/mat_ops.h"
 #include "tga_loader.cc"
@@ -7,6 +8,26 @@
 
 namespace rgg {
 
+// Glyphs laid out per frame, 6 vertices each
+#define MAX_TEXT_GLYPH 4096
+// Strings per frame whose layout is kept for the next frame
+#define MAX_TEXT_CACHE 64
+
+struct TextPoint {
+  GLfloat x;
+  GLfloat y;
+  GLfloat u;
+  GLfloat v;
+};
+
+// Layout of the string batched at the same position last frame
+struct TextCache {
+  // Of the message and its screen position
+  uint64_t hash;
+  uint32_t first_vertex;
+  uint32_t vertex_count;
+};
+
 struct Font {
   uint16_t texture_width;
   uint16_t texture_height;
@@ -22,6 +43,16 @@ struct Font {
 
 struct UI {
   Font font;
+  // Copy of the vbo contents
+  TextPoint vertex[MAX_TEXT_GLYPH * 6];
+  uint32_t vertex_count;
+  // Vertices changed since FlushText, uploaded by it
+  uint32_t dirty_begin;
+  uint32_t dirty_end;
+  TextCache cache[MAX_TEXT_CACHE];
+  uint32_t text_count;
+  // Window size of the projection set on the font program
+  math::Vec2f projection_size;
 };
 
 static UI kUI;
@@ -32,8 +63,11 @@ SetupUI()
   Font& font = kUI.font;
   uint8_t* image_data;
   uint16_t texture_width, texture_height;
-  LoadTGA("example/gfx/characters_0.tga", &image_data, &font.texture_width,
-          &font.texture_height);
+  uint64_t mark = ArenaMark(&kFrameArena);
+  if (!LoadTGA("example/gfx/characters_0.tga", &kFrameArena, &image_data,
+               &font.texture_width, &font.texture_height)) {
+    return false;
+  }
   font.metadata = LoadFntMetadata("example/gfx/characters.fnt");
   glGenTextures (1, &font.texture);
   font.texture_slot = GL_TEXTURE0;
@@ -50,7 +84,8 @@ SetupUI()
     GL_UNSIGNED_BYTE,
     image_data
   );
-  free(image_data); // GL has the texture data now. Free it from process.
+  // GL has the texture data now.
+  ArenaRestore(&kFrameArena, mark);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -81,40 +116,25 @@ SetupUI()
   glEnableVertexAttribArray(0);
   glBindBuffer(GL_ARRAY_BUFFER, font.vbo);
   glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+  // Sized once, FlushText only updates what changed.
+  glBufferData(GL_ARRAY_BUFFER, sizeof(kUI.vertex), NULL, GL_DYNAMIC_DRAW);
+  kUI.dirty_begin = MAX_TEXT_GLYPH * 6;
+  kUI.dirty_end = 0;
+  kUI.projection_size = math::Vec2f(0.f, 0.f);
 
   return true;
 }
 
-void
-DrawString(const char* msg, float x, float y, const math::Vec4f& color)
+// Writes the glyph quads of msg starting at out, at most max_glyph.
+// Returns the vertex count.
+uint32_t
+LayoutString(const char* msg, uint32_t len, float x, float y, TextPoint* out,
+             uint32_t max_glyph)
 {
-  struct TextPoint {
-    GLfloat x;
-    GLfloat y;
-    GLfloat u;
-    GLfloat v;
-    void Pr() { printf("%.1f,%.1f,%.1f,%.1f\n", x, y, u, v); }
-  };
-
-  auto& font = kUI.font;
-  glBindVertexArray(font.vao);
-  glBindTexture(GL_TEXTURE_2D, font.texture);
-
-  auto sz = window::GetWindowSize();
-  math::Mat4f projection = math::CreateOrthographicMatrix2<float>(
-      sz.x, 0.f, sz.y, 0.f, /* 2d so leave near/far 0*/ 0.f, 0.f);
-  glUniformMatrix4fv(font.matrix_uniform, 1, GL_FALSE, &projection[0]);
-
-#if 0
-  math::Print4x4Matrix(kUI.projection);
-  printf("\n");
-#endif
-
-  int msg_len = strlen(msg);
-  for (int i = 0; i < msg_len; ++i) {
-    TextPoint text_point[6];
-
-    const FntMetadataRow* row = &font.metadata.rows[msg[i]];
+  const Font& font = kUI.font;
+  if (len > max_glyph) len = max_glyph;
+  for (uint32_t i = 0; i < len; ++i) {
+    const FntMetadataRow* row = &font.metadata.rows[(uint8_t)msg[i]];
 
     // Scale to get uv coordinatoes.
     float tex_x = (float)row->x / font.texture_width;
@@ -127,16 +147,10 @@ DrawString(const char* msg, float x, float y, const math::Vec4f& color)
     float v_w = (float)row->width;
     float v_h = (float)row->height;
 
-    float offset_start_x = x/* - row->xoffset*/;
+    float offset_start_x = x;
     float offset_start_y = y - row->yoffset;
 
-#if 0
-    printf("id=%i char=%c width=%i height=%i xoffset=%i yoffset=%i"
-           " start_x=%.3f start_y=%.3f tex_w=%.3f tex_h=%.3f\n",
-           msg[i], msg[i], row->width, row->height, row->xoffset,
-           row->yoffset, offset_start_x, offset_start_y, tex_w, tex_h);
-#endif
-
+    TextPoint* text_point = &out[i * 6];
     text_point[0] = {offset_start_x, offset_start_y, tex_x, tex_y};
     text_point[1] = {offset_start_x + v_w, offset_start_y, tex_x + tex_w,
                      tex_y};
@@ -147,27 +161,74 @@ DrawString(const char* msg, float x, float y, const math::Vec4f& color)
     text_point[4] = {offset_start_x, offset_start_y - v_h, tex_x,
                      tex_y + tex_h};
     text_point[5] = {offset_start_x, offset_start_y, tex_x, tex_y};
-#if 0
-    text_point[0].Pr();
-    text_point[1].Pr();
-    text_point[2].Pr();
-    text_point[3].Pr();
-    text_point[4].Pr();
-    text_point[5].Pr();
-#endif
-    glBindBuffer(GL_ARRAY_BUFFER, font.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(text_point), text_point, GL_DYNAMIC_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, 6);  // Draw the character 
     x += v_w;
   }
+  return len * 6;
+}
+
+// Queues msg at screen x, y for the next FlushText. A string batched in the
+// same order, position and text as last frame keeps its layout.
+void
+BatchText(const char* msg, float x, float y, const math::Vec4f& color)
+{
+  uint32_t len = strlen(msg);
+  float position[2] = {x, y};
+  uint64_t hash = Hash64(msg, len, Hash64(position, sizeof(position), 0));
+  uint32_t first = kUI.vertex_count;
+
+  TextCache* cache = nullptr;
+  if (kUI.text_count < MAX_TEXT_CACHE) cache = &kUI.cache[kUI.text_count];
+  kUI.text_count += 1;
+  if (cache && cache->hash == hash && cache->first_vertex == first) {
+    kUI.vertex_count += cache->vertex_count;
+    return;
+  }
+
+  uint32_t max_glyph = MAX_TEXT_GLYPH - first / 6;
+  uint32_t count =
+      LayoutString(msg, len, x, y, &kUI.vertex[first], max_glyph);
+  kUI.vertex_count += count;
+  if (count) {
+    if (first < kUI.dirty_begin) kUI.dirty_begin = first;
+    if (first + count > kUI.dirty_end) kUI.dirty_end = first + count;
+  }
+  if (cache) *cache = TextCache{hash, first, count};
 }
 
+// Draws the text batched since the last call in one draw
 void
-RenderText(const char* msg, float x, float y, const math::Vec4f& color)
+FlushText()
 {
-  auto& font = kUI.font;
+  Font& font = kUI.font;
   glUseProgram(font.program);
-  DrawString(msg, x, y, color);
+  glBindVertexArray(font.vao);
+  glActiveTexture(font.texture_slot);
+  glBindTexture(GL_TEXTURE_2D, font.texture);
+
+  math::Vec2f sz = window::GetWindowSize();
+  if (sz.x != kUI.projection_size.x || sz.y != kUI.projection_size.y) {
+    math::Mat4f projection = math::CreateOrthographicMatrix2<float>(
+        sz.x, 0.f, sz.y, 0.f, /* 2d so leave near/far 0*/ 0.f, 0.f);
+    glUniformMatrix4fv(font.matrix_uniform, 1, GL_FALSE, &projection[0]);
+    kUI.projection_size = sz;
+  }
+
+  if (kUI.dirty_begin < kUI.dirty_end) {
+    glBindBuffer(GL_ARRAY_BUFFER, font.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, kUI.dirty_begin * sizeof(TextPoint),
+                    (kUI.dirty_end - kUI.dirty_begin) * sizeof(TextPoint),
+                    &kUI.vertex[kUI.dirty_begin]);
+  }
+  if (kUI.vertex_count) glDrawArrays(GL_TRIANGLES, 0, kUI.vertex_count);
+
+  // Cache entries past this frame's strings describe nothing valid now.
+  for (uint32_t i = kUI.text_count; i < MAX_TEXT_CACHE; ++i) {
+    kUI.cache[i] = TextCache{};
+  }
+  kUI.vertex_count = 0;
+  kUI.text_count = 0;
+  kUI.dirty_begin = MAX_TEXT_GLYPH * 6;
+  kUI.dirty_end = 0;
 }
 
 }
@@ -4,6 +4,9 @@ namespace rgg {
 
 bool SetupUI();
 
-void RenderText(const char* msg, float x, float y, const math::Vec4f& color);
+// Queue msg at screen x, y, drawn with all queued text by FlushText.
+void BatchText(const char* msg, float x, float y, const math::Vec4f& color);
+
+void FlushText();
 
 }
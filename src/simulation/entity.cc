@@ -36,8 +36,8 @@ DECLARE_GAME_QUEUE(Command, 16);
 struct Unit {
   Transform transform;
   Command command;
-  uint64_t think_flags = 0;
   int kind = 0;
+  uint64_t think_flags = 0;
 };
 
 DECLARE_GAME_TYPE(Unit, 8);
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstring>
+
+#include "common/heap.cc"
+#include "math/vec.h"
+
+namespace search
+{
+// Octile step costs, diagonal ~ straight * sqrt(2)
+constexpr uint32_t kCostStraight = 10;
+constexpr uint32_t kCostDiagonal = 14;
+
+// Row major walkability, paths may step onto any open cell including
+// diagonally between two blocked cells
+struct Grid {
+  int width;
+  int height;
+  const uint8_t* open;
+};
+
+// Caller owned scratch for grids of up to max_cells, reused between queries.
+// A cell has valid cost and parent only when its stamp is the current
+// generation (open) or generation + 1 (closed). Each query advances the
+// generation, so no per-query clearing of the cell arrays is needed.
+struct GridSearch {
+  uint32_t generation;
+  uint32_t max_cells;
+  uint32_t* stamp;
+  uint32_t* cost;
+  uint32_t* parent;
+  // Open list, duplicates are pushed instead of decreasing keys
+  HeapNode* heap;
+  uint64_t heap_size;
+  uint64_t max_heap;
+};
+
+// Scratch bytes for grids of up to max_cells
+constexpr uint64_t
+GridSearchBytes(uint32_t max_cells)
+{
+  return (uint64_t)max_cells * (3 * sizeof(uint32_t) + 2 * sizeof(HeapNode));
+}
+
+// Carves s out of memory, which holds GridSearchBytes(max_cells)
+void
+GridSearchInit(GridSearch* s, void* memory, uint32_t max_cells)
+{
+  static_assert(alignof(HeapNode) <= alignof(uint32_t),
+                "Scratch arrays are packed at uint32_t alignment");
+  memset(memory, 0, GridSearchBytes(max_cells));
+  s->generation = 0;
+  s->max_cells = max_cells;
+  s->stamp = (uint32_t*)memory;
+  s->cost = s->stamp + max_cells;
+  s->parent = s->cost + max_cells;
+  s->heap = (HeapNode*)(s->parent + max_cells);
+  s->heap_size = 0;
+  s->max_heap = 2 * (uint64_t)max_cells;
+}
+
+inline bool
+GridOpen(const Grid& grid, int x, int y)
+{
+  if ((unsigned)x >= (unsigned)grid.width) return false;
+  if ((unsigned)y >= (unsigned)grid.height) return false;
+  return grid.open[y * grid.width + x];
+}
+
+inline uint32_t
+Octile(int dx, int dy)
+{
+  dx = dx < 0 ? -dx : dx;
+  dy = dy < 0 ? -dy : dy;
+  int lo = dx < dy ? dx : dy;
+  int hi = dx < dy ? dy : dx;
+  return kCostDiagonal * lo + kCostStraight * (hi - lo);
+}
+
+inline int
+Sign(int v)
+{
+  return (v > 0) - (v < 0);
+}
+
+void
+GridSearchBegin(GridSearch* s)
+{
+  if (s->generation >= UINT32_MAX - 2) {
+    memset(s->stamp, 0, s->max_cells * sizeof(uint32_t));
+    s->generation = 0;
+  }
+  s->generation += 2;
+  s->heap_size = 0;
+}
+
+// Relax cell with a path of cost through from, false when the open list
+// is exhausted
+bool
+GridSearchRelax(GridSearch* s, const Grid& grid, uint32_t from, uint32_t cell,
+                uint32_t cost, const math::Vec2i& end)
+{
+  uint32_t gen = s->generation;
+  if (s->stamp[cell] == gen + 1) return true;
+  if (s->stamp[cell] == gen && s->cost[cell] <= cost) return true;
+  if (s->heap_size == s->max_heap) return false;
+
+  s->stamp[cell] = gen;
+  s->cost[cell] = cost;
+  s->parent[cell] = from;
+  int x = cell % grid.width;
+  int y = cell / grid.width;
+  uint32_t f = cost + Octile(end.x - x, end.y - y);
+  HeapPush(s->heap, &s->heap_size, HeapNode{f, cell});
+  return true;
+}
+
+// Returns the next cell to expand, or false when the open list is empty
+bool
+GridSearchNext(GridSearch* s, uint32_t* cell)
+{
+  uint32_t gen = s->generation;
+  while (s->heap_size) {
+    HeapNode node = HeapPop(s->heap, &s->heap_size);
+    // Skip stale duplicates of closed cells
+    if (s->stamp[node.data] != gen) continue;
+    s->stamp[node.data] = gen + 1;
+    *cell = node.data;
+    return true;
+  }
+  return false;
+}
+
+// Walks parents from end, filling the straight or diagonal runs between
+// them. Returns the tile count, or 0 when max_out is too small.
+int
+GridSearchPath(const GridSearch* s, const Grid& grid, uint32_t start,
+               uint32_t end, math::Vec2i* out, int max_out)
+{
+  int size = 0;
+  uint32_t cell = end;
+  math::Vec2i pos(end % grid.width, end / grid.width);
+  if (max_out < 1) return 0;
+  out[size++] = pos;
+  while (cell != start) {
+    uint32_t from = s->parent[cell];
+    math::Vec2i target(from % grid.width, from / grid.width);
+    math::Vec2i step(Sign(target.x - pos.x), Sign(target.y - pos.y));
+    while (pos != target) {
+      if (size == max_out) return 0;
+      pos += step;
+      out[size++] = pos;
+    }
+    cell = from;
+  }
+
+  // Reverse it
+  for (int i = 0, e = size - 1; i < e; ++i, --e) {
+    auto t = out[e];
+    out[e] = out[i];
+    out[i] = t;
+  }
+  return size;
+}
+
+bool
+GridSearchValid(const GridSearch* s, const Grid& grid,
+                const math::Vec2i& start, const math::Vec2i& end)
+{
+  if ((uint64_t)grid.width * grid.height > s->max_cells) return false;
+  if ((unsigned)start.x >= (unsigned)grid.width) return false;
+  if ((unsigned)start.y >= (unsigned)grid.height) return false;
+  return GridOpen(grid, end.x, end.y);
+}
+
+// Shortest octile path from start to end inclusive, written to out.
+// Returns the tile count, or 0 without a path or out of scratch.
+int
+AStar(GridSearch* s, const Grid& grid, const math::Vec2i& start,
+      const math::Vec2i& end, math::Vec2i* out, int max_out)
+{
+  if (!GridSearchValid(s, grid, start, end)) return 0;
+
+  GridSearchBegin(s);
+  const uint32_t start_cell = start.y * grid.width + start.x;
+  const uint32_t end_cell = end.y * grid.width + end.x;
+  GridSearchRelax(s, grid, start_cell, start_cell, 0, end);
+
+  uint32_t cell;
+  while (GridSearchNext(s, &cell)) {
+    if (cell == end_cell) {
+      return GridSearchPath(s, grid, start_cell, end_cell, out, max_out);
+    }
+
+    int x = cell % grid.width;
+    int y = cell / grid.width;
+    uint32_t cost = s->cost[cell];
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        if (!GridOpen(grid, x + dx, y + dy)) continue;
+        if (!dx && !dy) continue;
+        uint32_t step = (dx && dy) ? kCostDiagonal : kCostStraight;
+        uint32_t next = (y + dy) * grid.width + x + dx;
+        if (!GridSearchRelax(s, grid, cell, next, cost + step, end)) return 0;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Follows (dx, dy) from (x, y) until a cell with a forced neighbor, the end,
+// or a wall. Diagonal runs also stop where a straight run would find one.
+bool
+Jump(const Grid& grid, int x, int y, int dx, int dy, const math::Vec2i& end,
+     math::Vec2i* jump_point)
+{
+  for (;; x += dx, y += dy) {
+    if (!GridOpen(grid, x, y)) return false;
+    if (x == end.x && y == end.y) break;
+
+    if (dx && dy) {
+      if (GridOpen(grid, x - dx, y + dy) && !GridOpen(grid, x - dx, y)) break;
+      if (GridOpen(grid, x + dx, y - dy) && !GridOpen(grid, x, y - dy)) break;
+      math::Vec2i unused;
+      if (Jump(grid, x + dx, y, dx, 0, end, &unused)) break;
+      if (Jump(grid, x, y + dy, 0, dy, end, &unused)) break;
+    } else if (dx) {
+      if (GridOpen(grid, x + dx, y + 1) && !GridOpen(grid, x, y + 1)) break;
+      if (GridOpen(grid, x + dx, y - 1) && !GridOpen(grid, x, y - 1)) break;
+    } else {
+      if (GridOpen(grid, x + 1, y + dy) && !GridOpen(grid, x + 1, y)) break;
+      if (GridOpen(grid, x - 1, y + dy) && !GridOpen(grid, x - 1, y)) break;
+    }
+  }
+
+  *jump_point = math::Vec2i(x, y);
+  return true;
+}
+
+// Jump point search: A* over the same moves that only expands cells where
+// an optimal path may turn. Same result cost as AStar.
+int
+JumpPoint(GridSearch* s, const Grid& grid, const math::Vec2i& start,
+          const math::Vec2i& end, math::Vec2i* out, int max_out)
+{
+  if (!GridSearchValid(s, grid, start, end)) return 0;
+
+  GridSearchBegin(s);
+  const uint32_t start_cell = start.y * grid.width + start.x;
+  const uint32_t end_cell = end.y * grid.width + end.x;
+  GridSearchRelax(s, grid, start_cell, start_cell, 0, end);
+
+  uint32_t cell;
+  while (GridSearchNext(s, &cell)) {
+    if (cell == end_cell) {
+      return GridSearchPath(s, grid, start_cell, end_cell, out, max_out);
+    }
+
+    int x = cell % grid.width;
+    int y = cell / grid.width;
+    uint32_t cost = s->cost[cell];
+
+    // Pruned neighbor directions given the direction of arrival
+    math::Vec2i dir[8];
+    int dir_count = 0;
+    if (cell == start_cell) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          if (dx || dy) dir[dir_count++] = math::Vec2i(dx, dy);
+        }
+      }
+    } else {
+      uint32_t from = s->parent[cell];
+      int dx = Sign(x - (int)(from % grid.width));
+      int dy = Sign(y - (int)(from / grid.width));
+      if (dx && dy) {
+        dir[dir_count++] = math::Vec2i(0, dy);
+        dir[dir_count++] = math::Vec2i(dx, 0);
+        dir[dir_count++] = math::Vec2i(dx, dy);
+        if (!GridOpen(grid, x - dx, y)) dir[dir_count++] = math::Vec2i(-dx, dy);
+        if (!GridOpen(grid, x, y - dy)) dir[dir_count++] = math::Vec2i(dx, -dy);
+      } else if (dx) {
+        dir[dir_count++] = math::Vec2i(dx, 0);
+        if (!GridOpen(grid, x, y + 1)) dir[dir_count++] = math::Vec2i(dx, 1);
+        if (!GridOpen(grid, x, y - 1)) dir[dir_count++] = math::Vec2i(dx, -1);
+      } else {
+        dir[dir_count++] = math::Vec2i(0, dy);
+        if (!GridOpen(grid, x + 1, y)) dir[dir_count++] = math::Vec2i(1, dy);
+        if (!GridOpen(grid, x - 1, y)) dir[dir_count++] = math::Vec2i(-1, dy);
+      }
+    }
+
+    for (int i = 0; i < dir_count; ++i) {
+      math::Vec2i jp;
+      if (!Jump(grid, x + dir[i].x, y + dir[i].y, dir[i].x, dir[i].y, end,
+                &jp)) {
+        continue;
+      }
+      uint32_t next = jp.y * grid.width + jp.x;
+      uint32_t step = Octile(jp.x - x, jp.y - y);
+      if (!GridSearchRelax(s, grid, cell, next, cost + step, end)) return 0;
+    }
+  }
+
+  return 0;
+}
+
+}  // namespace search
@@ -6,9 +6,27 @@
 
 namespace search
 {
-struct PathNode {
-  math::Vec2i from;
-  bool checked;
+// Distance for tiles without a path to the destination
+constexpr uint16_t kFlowUnreached = UINT16_MAX;
+// Step for tiles without a path to the destination
+constexpr uint8_t kFlowNone = UINT8_MAX;
+// Destinations kept in the flow field cache
+constexpr int kMaxFlowField = 16;
+// kNeighbor index of the reverse direction
+static const uint8_t kOpposite[tilemap::kMaxNeighbor] = {1, 0, 3, 2,
+                                                         7, 6, 5, 4};
+
+// Every tile's next step towards one destination.
+// Units heading to the same tile share a field, it is rebuilt only after
+// the tilemap changes.
+struct FlowField {
+  // kTilemapVersion the field was built against, 0 when unused
+  uint64_t version;
+  uint64_t last_use;
+  math::Vec2i end;
+  uint16_t distance[tilemap::kMapHeight][tilemap::kMapWidth];
+  // kNeighbor index towards end
+  uint8_t step[tilemap::kMapHeight][tilemap::kMapWidth];
 };
 
 struct Path {
@@ -17,71 +35,127 @@ struct Path {
 };
 
 struct Search {
-  // Map used for pathfinding calculations.
-  PathNode path_map[tilemap::kMapHeight][tilemap::kMapWidth];
+  FlowField flow[kMaxFlowField];
+  uint64_t use_clock;
   // BFS queue.
   math::Vec2i queue[tilemap::kMapHeight * tilemap::kMapWidth];
-  int queue_size;
-  int queue_ptr;
   // The resulting path as calculated from the last call to PathTo.
   Path path;
 };
 
 static Search kSearch;
 
-Path*
-PathTo(const math::Vec2i& start, const math::Vec2i& end)
+// Breadth first from end, so each open tile learns its step back towards it
+void
+BuildFlowField(const math::Vec2i& end, FlowField* field)
 {
-  if (!tilemap::TileOk(end)) return nullptr;
-  if (!tilemap::TileOk(start)) return nullptr;
+  memset(field->distance, 0xff, sizeof(field->distance));
+  memset(field->step, kFlowNone, sizeof(field->step));
+  field->version = tilemap::kTilemapVersion;
+  field->end = end;
 
-  constexpr int N = tilemap::kMapHeight * tilemap::kMapWidth;
-  memset(kSearch.path_map, 0, sizeof(PathNode) * N);
-  kSearch.queue_size = 0;
-  kSearch.queue_ptr = 0;
-  kSearch.path.size = 0;
+  // Paths may only enter open tiles
+  if (tilemap::TileTypeSafe(end) != tilemap::kTileOpen) return;
 
   auto& queue = kSearch.queue;
-  int& qsz = kSearch.queue_size;
-  int& qptr = kSearch.queue_ptr;
-  auto& path_map = kSearch.path_map;
+  int qsz = 0;
+  int qptr = 0;
+  queue[qsz++] = end;
+  field->distance[end.y][end.x] = 0;
+
+  while (qptr < qsz) {
+    const math::Vec2i node = queue[qptr++];
+    uint16_t distance = field->distance[node.y][node.x] + 1;
+    for (uint64_t open = tilemap::OpenNeighborMask(node); open;
+         open = BLSR(open)) {
+      int i = TZCNT(open);
+      const math::Vec2i neighbor = node + tilemap::kNeighbor[i];
+      if (field->distance[neighbor.y][neighbor.x] != kFlowUnreached) continue;
+
+      field->distance[neighbor.y][neighbor.x] = distance;
+      field->step[neighbor.y][neighbor.x] = kOpposite[i];
+      queue[qsz++] = neighbor;
+    }
+  }
+}
 
-  queue[qsz++] = start;
-  path_map[start.y][start.x].from = start;
-  path_map[start.y][start.x].checked = true;
+// Returns the cached field for end, building it when missing or stale
+const FlowField*
+FlowTo(const math::Vec2i& end)
+{
+  if (!tilemap::TileOk(end)) return nullptr;
 
-  while (1) {
-    // No Path
-    if (qptr == qsz) return nullptr;
+  FlowField* field = &kSearch.flow[0];
+  for (int i = 0; i < kMaxFlowField; ++i) {
+    FlowField* f = &kSearch.flow[i];
+    if (f->version && f->end == end) {
+      field = f;
+      break;
+    }
+    if (f->last_use < field->last_use) field = f;
+  }
 
-    auto& node = queue[qptr++];
-    // Path success
-    if (node == end) break;
+  if (field->version != tilemap::kTilemapVersion || field->end != end) {
+    BuildFlowField(end, field);
+  }
+  field->last_use = ++kSearch.use_clock;
 
-    for (int i = 0; i < tilemap::kMaxNeighbor; ++i) {
-      const math::Vec2i neighbor = node + tilemap::kNeighbor[i];
-      if (tilemap::TileTypeSafe(neighbor) != tilemap::kTileOpen) continue;
+  return field;
+}
 
-      if (path_map[neighbor.y][neighbor.x].checked == true) continue;
-      path_map[neighbor.y][neighbor.x].checked = true;
-      path_map[neighbor.y][neighbor.x].from = node;
+// Returns true with the tile after start on field's shortest path.
+// Only reads the field, safe to call from many threads at once.
+bool
+NextTileOnField(const FlowField* field, const math::Vec2i& start,
+                math::Vec2i* next)
+{
+  if (!field) return false;
+  if (!tilemap::TileOk(start)) return false;
+  if (start == field->end) return false;
+
+  uint8_t step = field->step[start.y][start.x];
+  if (step != kFlowNone) {
+    *next = start + tilemap::kNeighbor[step];
+    return true;
+  }
 
-      queue[qsz++] = neighbor;
+  // A start off the field (e.g. inside a wall) may step onto it
+  uint16_t best = kFlowUnreached;
+  for (int i = 0; i < tilemap::kMaxNeighbor; ++i) {
+    const math::Vec2i neighbor = start + tilemap::kNeighbor[i];
+    if (!tilemap::TileOk(neighbor)) continue;
+    uint16_t distance = field->distance[neighbor.y][neighbor.x];
+    if (distance < best) {
+      best = distance;
+      *next = neighbor;
     }
   }
 
+  return best != kFlowUnreached;
+}
+
+// Returns true with the tile after start on a shortest path to end
+bool
+NextTile(const math::Vec2i& start, const math::Vec2i& end, math::Vec2i* next)
+{
+  if (!tilemap::TileOk(start)) return false;
+  if (start == end) return false;
+  return NextTileOnField(FlowTo(end), start, next);
+}
+
+Path*
+PathTo(const math::Vec2i& start, const math::Vec2i& end)
+{
+  if (!tilemap::TileOk(end)) return nullptr;
+  if (!tilemap::TileOk(start)) return nullptr;
+
   auto& path = kSearch.path;
   auto& psz = kSearch.path.size;
-  path.tile[psz++] = end;
-  while (path.tile[psz - 1] != start) {
-    auto& prev = path.tile[psz - 1];
-    path.tile[psz++] = path_map[prev.y][prev.x].from;
-  }
-  // Reverse it
-  for (int i = 0, e = psz - 1; i < e; ++i, --e) {
-    auto t = path.tile[e];
-    path.tile[e] = path.tile[i];
-    path.tile[i] = t;
+  psz = 0;
+  path.tile[psz++] = start;
+  while (path.tile[psz - 1] != end) {
+    if (!NextTile(path.tile[psz - 1], end, &path.tile[psz])) return nullptr;
+    psz += 1;
   }
 #if 0
   printf("Path is\n\n");
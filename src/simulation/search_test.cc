@@ -0,0 +1,195 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "grid_search.cc"
+#include "search.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+#define ARRAY_LENGTH(x) (sizeof(x) / sizeof(x[0]))
+
+// Unit step lengths of the shortest path, by plain BFS from start
+int
+ReferenceDistance(math::Vec2i start, math::Vec2i end)
+{
+  static int distance[tilemap::kMapHeight][tilemap::kMapWidth];
+  static math::Vec2i queue[tilemap::kMapHeight * tilemap::kMapWidth];
+  memset(distance, -1, sizeof(distance));
+  int qsz = 0, qptr = 0;
+  queue[qsz++] = start;
+  distance[start.y][start.x] = 0;
+  while (qptr < qsz) {
+    math::Vec2i node = queue[qptr++];
+    if (node == end) return distance[node.y][node.x];
+    for (int i = 0; i < tilemap::kMaxNeighbor; ++i) {
+      math::Vec2i n = node + tilemap::kNeighbor[i];
+      if (tilemap::TileTypeSafe(n) != tilemap::kTileOpen) continue;
+      if (distance[n.y][n.x] != -1) continue;
+      distance[n.y][n.x] = distance[node.y][node.x] + 1;
+      queue[qsz++] = n;
+    }
+  }
+  return -1;
+}
+
+void
+ShortestPaths()
+{
+  const math::Vec2i end(21, 9);
+  for (int y = 0; y < tilemap::kMapHeight; ++y) {
+    for (int x = 0; x < tilemap::kMapWidth; ++x) {
+      math::Vec2i start(x, y);
+      search::Path* path = search::PathTo(start, end);
+      int expected = ReferenceDistance(start, end);
+      if (expected < 0) {
+        ASSERT_TRUE(!path);
+        continue;
+      }
+      ASSERT_TRUE(path);
+      ASSERT_TRUE(path->size == expected + 1);
+      for (int i = 1; i < path->size; ++i) {
+        ASSERT_TRUE(tilemap::TileTypeSafe(path->tile[i]) == tilemap::kTileOpen);
+      }
+    }
+  }
+}
+
+void
+CacheInvalidation()
+{
+  const math::Vec2i start(2, 2);
+  const math::Vec2i end(2, 30);
+  const search::FlowField* field = search::FlowTo(end);
+  ASSERT_TRUE(search::FlowTo(end) == field);
+  uint64_t version = field->version;
+  int before = search::PathTo(start, end)->size;
+
+  // Wall off the direct route
+  for (int x = 0; x < tilemap::kMapWidth - 1; ++x) {
+    tilemap::SetTileType(math::Vec2i(x, 16), tilemap::kTileBlock);
+  }
+  ASSERT_TRUE(search::FlowTo(end)->version != version);
+  int after = search::PathTo(start, end)->size;
+  ASSERT_TRUE(after > before);
+
+  // Closing the gap leaves no path
+  tilemap::SetTileType(math::Vec2i(tilemap::kMapWidth - 1, 16),
+                       tilemap::kTileBlock);
+  ASSERT_TRUE(!search::PathTo(start, end));
+  math::Vec2i next;
+  ASSERT_TRUE(!search::NextTile(start, end, &next));
+}
+
+static uint8_t kOpen[1024 * 1024];
+static math::Vec2i kOut[1024 * 1024];
+alignas(8) static uint8_t
+    kScratch[search::GridSearchBytes(ARRAY_LENGTH(kOpen))];
+static search::GridSearch kGridSearch;
+
+uint32_t
+PathCost(const search::Grid& grid, const math::Vec2i* tile, int size)
+{
+  uint32_t cost = 0;
+  for (int i = 1; i < size; ++i) {
+    math::Vec2i d = tile[i] - tile[i - 1];
+    ASSERT_TRUE(abs(d.x) <= 1 && abs(d.y) <= 1 && (d.x || d.y));
+    ASSERT_TRUE(search::GridOpen(grid, tile[i].x, tile[i].y));
+    cost += (d.x && d.y) ? search::kCostDiagonal : search::kCostStraight;
+  }
+  return cost;
+}
+
+search::Grid
+RandomGrid(int width, int height, int wall_percent)
+{
+  for (int i = 0; i < width * height; ++i) {
+    kOpen[i] = rand() % 100 >= wall_percent;
+  }
+  return search::Grid{width, height, kOpen};
+}
+
+// A* and JPS must agree on the optimal cost, and on when there is no path
+void
+AStarMatchesJumpPoint()
+{
+  srand(11);
+  for (int trial = 0; trial < 200; ++trial) {
+    int w = 8 + rand() % 64;
+    int h = 8 + rand() % 64;
+    search::Grid grid = RandomGrid(w, h, rand() % 40);
+    math::Vec2i start(rand() % w, rand() % h);
+    math::Vec2i end(rand() % w, rand() % h);
+
+    int astar = search::AStar(&kGridSearch, grid, start, end, kOut,
+                              ARRAY_LENGTH(kOut));
+    uint32_t astar_cost = astar ? PathCost(grid, kOut, astar) : 0;
+    if (astar) {
+      ASSERT_TRUE(kOut[0] == start);
+      ASSERT_TRUE(kOut[astar - 1] == end);
+    }
+    int jps = search::JumpPoint(&kGridSearch, grid, start, end, kOut,
+                                ARRAY_LENGTH(kOut));
+    uint32_t jps_cost = jps ? PathCost(grid, kOut, jps) : 0;
+    if (jps) {
+      ASSERT_TRUE(kOut[0] == start);
+      ASSERT_TRUE(kOut[jps - 1] == end);
+    }
+    ASSERT_TRUE(!astar == !jps);
+    ASSERT_TRUE(astar_cost == jps_cost);
+  }
+}
+
+// Query cost on a 1024x1024 map, corner to corner
+void
+LargeMap()
+{
+  srand(3);
+  search::Grid grid = RandomGrid(1024, 1024, 20);
+  math::Vec2i start(0, 0);
+  math::Vec2i end(1023, 1023);
+  kOpen[0] = kOpen[1024 * 1024 - 1] = 1;
+
+  const int kQueries = 4;
+  clock_t c = clock();
+  int astar = 0;
+  for (int i = 0; i < kQueries; ++i) {
+    astar = search::AStar(&kGridSearch, grid, start, end, kOut,
+                          ARRAY_LENGTH(kOut));
+  }
+  double astar_ms = 1000.0 * (clock() - c) / CLOCKS_PER_SEC / kQueries;
+  uint32_t astar_cost = PathCost(grid, kOut, astar);
+
+  c = clock();
+  int jps = 0;
+  for (int i = 0; i < kQueries; ++i) {
+    jps = search::JumpPoint(&kGridSearch, grid, start, end, kOut,
+                            ARRAY_LENGTH(kOut));
+  }
+  double jps_ms = 1000.0 * (clock() - c) / CLOCKS_PER_SEC / kQueries;
+  ASSERT_TRUE(astar && jps);
+  ASSERT_TRUE(PathCost(grid, kOut, jps) == astar_cost);
+
+  printf("1024x1024 astar %.2f ms jps %.2f ms (%d tiles)\n", astar_ms, jps_ms,
+         jps);
+
+  // Scratch sized for fewer cells refuses the grid
+  search::GridSearch small;
+  search::GridSearchInit(&small, kScratch, 1024 * 1024 - 1);
+  ASSERT_TRUE(!search::AStar(&small, grid, start, end, kOut,
+                             ARRAY_LENGTH(kOut)));
+}
+
+int
+main()
+{
+  tilemap::Initialize();
+  search::GridSearchInit(&kGridSearch, kScratch, ARRAY_LENGTH(kOpen));
+  ShortestPaths();
+  CacheInvalidation();
+  AStarMatchesJumpPoint();
+  LargeMap();
+  printf("search ok\n");
+  return 0;
+}
@@ -5,11 +5,42 @@
 #include "platform/macro.h"
 #include "platform/x64_intrin.h"
 
+#include "common/job.cc"
+#include "common/profile.cc"
 #include "entity.cc"
 #include "search.cc"
 
 namespace simulation
 {
+// Hash of simulation state at the end of the last Update
+static uint64_t kIntegrityHash;
+// Unit movement runs on the job system workers, see UpdateUnits
+static bool kParallelUpdate;
+// Units moved per job. Fewer units than this move on the calling thread,
+// since a job costs more than moving a handful of units.
+static uint64_t kMoveGrain = 64;
+
+// False while kMaxUnit units fit in one job, workers would get no work
+bool
+ParallelUpdateUseful()
+{
+  return kMaxUnit > kMoveGrain;
+}
+
+// A unit's movement for this tick, computed from the unit as it was at the
+// start of the tick and committed in unit order
+struct UnitStep {
+  const search::FlowField* field;
+  math::Vec3f position;
+  Command command;
+};
+
+static UnitStep kUnitStep[kMaxUnit];
+
+// Each tick's fields stay cached until every unit has moved
+static_assert(kMaxUnit <= search::kMaxFlowField,
+              "A flow field in use may be evicted");
+
 enum AiGoals {
   kAiPower = 0,
   kAiMine,
@@ -17,6 +48,48 @@ enum AiGoals {
   kAiGoals = 64,
 };
 
+// State is hashed as bytes, padding would hash indeterminate values
+static_assert(sizeof(Transform) ==
+                  2 * sizeof(math::Vec3f) + sizeof(math::Quatf),
+              "Transform has padding");
+static_assert(sizeof(Command) == sizeof(Command::Type) + sizeof(math::Vec2f),
+              "Command has padding");
+static_assert(sizeof(Unit) == sizeof(Transform) + sizeof(Command) +
+                                  sizeof(int) + sizeof(uint64_t),
+              "Unit has padding");
+static_assert(sizeof(Asteroid) == sizeof(Transform), "Asteroid has padding");
+static_assert(sizeof(Pod) == sizeof(Transform), "Pod has padding");
+static_assert(sizeof(Ship) == sizeof(uint64_t), "Ship has padding");
+static_assert(sizeof(tilemap::Tilemap) ==
+                  sizeof(tilemap::Tilemap::type) +
+                      sizeof(tilemap::Tilemap::occupancy),
+              "Tilemap has padding");
+
+// Hash of kTilemap and 1 + the kTilemapVersion it was taken at, 0 when unset
+static uint64_t kTilemapHash;
+static uint64_t kTilemapHashVersion;
+
+// Hash of all state mutated by the simulation, equal on every lockstep peer
+// The tilemap, most of the state, is only rehashed when its version changes
+uint64_t
+Hash()
+{
+  if (kTilemapHashVersion != tilemap::kTilemapVersion + 1) {
+    kTilemapHash = Hash64(&tilemap::kTilemap, sizeof(tilemap::kTilemap), 0);
+    kTilemapHashVersion = tilemap::kTilemapVersion + 1;
+  }
+
+  uint64_t h = kTilemapHash;
+  h = Hash64(kUnit, kUsedUnit * sizeof(Unit), h);
+  h = Hash64(kAsteroid, kUsedAsteroid * sizeof(Asteroid), h);
+  h = Hash64(kPod, kUsedPod * sizeof(Pod), h);
+  h = Hash64(kShip, kUsedShip * sizeof(Ship), h);
+  uint64_t command_cursor[2] = {kReadCommand, kWriteCommand};
+  h = Hash64(command_cursor, sizeof(command_cursor), h);
+  h = Hash64(kCommand, sizeof(kCommand), h);
+  return h;
+}
+
 bool
 Initialize()
 {
@@ -46,14 +119,17 @@ Initialize()
 
   tilemap::Initialize();
 
+  kIntegrityHash = Hash();
+
   return true;
 }
 
+// True when no simulation state changed since the end of the last Update
+// Tilemap changes are seen through kTilemapVersion
 bool
 VerifyIntegrity()
 {
-  // TODO (AN): Checksum of kEntity compared to end of last frame
-  return true;
+  return Hash() == kIntegrityHash;
 }
 
 void
@@ -109,20 +185,21 @@ Decide()
         i, unit->think_flags, possible, kShip[0].satisfied_flags);
     printf("%lu action\n", action);
 #endif
+    math::Vec2f from = unit->transform.position.xy();
     math::Vec2f pos;
     switch (action) {
       case kAiMine:
-        if (WorldPositionOfTile(tilemap::kTileMine, &pos)) {
+        if (WorldPositionOfTile(tilemap::kTileMine, from, &pos)) {
           unit->command = Command{.type = Command::kMove, .destination = pos};
         }
         break;
       case kAiPower:
-        if (WorldPositionOfTile(tilemap::kTilePower, &pos)) {
+        if (WorldPositionOfTile(tilemap::kTilePower, from, &pos)) {
           unit->command = Command{.type = Command::kMove, .destination = pos};
         }
         break;
       case kAiThrust:
-        if (WorldPositionOfTile(tilemap::kTileEngine, &pos)) {
+        if (WorldPositionOfTile(tilemap::kTileEngine, from, &pos)) {
           unit->command = Command{.type = Command::kMove, .destination = pos};
         }
         break;
@@ -131,17 +208,19 @@ Decide()
   }
 }
 
+// Reads kUnit, the tilemap and the flow fields, writes only kUnitStep
 void
-Update()
+MoveUnits(void*, uint64_t begin, uint64_t end)
 {
-  Think();
-  Decide();
-
+  PROFILE_SCOPE("move_units");
   using namespace tilemap;
 
-  for (int i = 0; i < kUsedUnit; ++i) {
-    Unit* unit = &kUnit[i];
-    Transform* transform = &unit->transform;
+  for (uint64_t i = begin; i < end; ++i) {
+    const Unit* unit = &kUnit[i];
+    const Transform* transform = &unit->transform;
+    UnitStep* step = &kUnitStep[i];
+    step->position = transform->position;
+    step->command = unit->command;
 
     switch (unit->command.type) {
       case Command::kNone: {
@@ -150,22 +229,61 @@ Update()
       } break;
       case Command::kMove: {
         math::Vec2i start = WorldToTilePos(transform->position.xy());
-        math::Vec2i end = WorldToTilePos(unit->command.destination);
 
-        auto* path = search::PathTo(start, end);
-        if (!path || path->size <= 1) {
-          unit->command = {};
+        math::Vec2i next;
+        if (!search::NextTileOnField(step->field, start, &next)) {
+          step->command = {};
           continue;
         }
 
-        math::Vec3f dest = TilePosToWorld(path->tile[1]);
+        math::Vec3f dest = TilePosToWorld(next);
         auto dir = math::Normalize(dest - transform->position.xy());
-        transform->position += (dir * 1.f) + (TileAvoidWalls(start) * .15f);
+        step->position += (dir * 1.f) + (TileAvoidWalls(start) * .15f);
       } break;
       default:
         break;
     }
   }
+}
+
+// Lockstep peers may use any worker count: each unit's step depends only on
+// state from the start of the tick, and steps commit in unit order.
+// Only movement is split across workers. Path search (FlowTo) stays on the
+// calling thread, since building a flow field mutates the shared cache.
+void
+UpdateUnits()
+{
+  PROFILE_SCOPE("units");
+  for (int i = 0; i < kUsedUnit; ++i) {
+    const Command& command = kUnit[i].command;
+    kUnitStep[i].field = nullptr;
+    if (command.type != Command::kMove) continue;
+    math::Vec2i end = tilemap::WorldToTilePos(command.destination);
+    kUnitStep[i].field = search::FlowTo(end);
+  }
+
+  if (kParallelUpdate && kUsedUnit > kMoveGrain) {
+    JobCounter counter = {};
+    JobParallelFor(kUsedUnit, kMoveGrain, MoveUnits, nullptr, &counter);
+    JobWait(&counter);
+  } else {
+    MoveUnits(nullptr, 0, kUsedUnit);
+  }
+
+  for (int i = 0; i < kUsedUnit; ++i) {
+    kUnit[i].transform.position = kUnitStep[i].position;
+    kUnit[i].command = kUnitStep[i].command;
+  }
+}
+
+void
+Update()
+{
+  PROFILE_SCOPE("simulation");
+  Think();
+  Decide();
+
+  UpdateUnits();
 
   for (int i = 0; i < kUsedAsteroid; ++i) {
     Asteroid* asteroid = &kAsteroid[i];
@@ -181,6 +299,8 @@ Update()
       pod->transform.position += goal;
     }
   }
+
+  kIntegrityHash = Hash();
 }
 
 }  // namespace simulation
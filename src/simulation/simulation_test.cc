@@ -0,0 +1,131 @@
+#include <cassert>
+#include <cstdio>
+
+#include "simulation.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+constexpr int kTicks = 4000;
+constexpr int kWorkers = 4;
+
+static uint64_t kSerialHash[kTicks];
+static uint64_t kRandom;
+
+// Same sequence for every run, independent of libc
+uint32_t
+Random()
+{
+  kRandom = kRandom * 6364136223846793005ull + 1442695040888963407ull;
+  return kRandom >> 33;
+}
+
+math::Vec2i
+RandomTile()
+{
+  return math::Vec2i(Random() % tilemap::kMapWidth,
+                     Random() % tilemap::kMapHeight);
+}
+
+void
+Reset()
+{
+  kUsedUnit = kUsedAsteroid = kUsedPod = kUsedShip = 0;
+  for (Unit& unit : kUnit) unit = Unit{};
+  for (Ship& ship : kShip) ship = Ship{};
+  kReadCommand = kWriteCommand = 0;
+  for (Command& command : kCommand) command = Command{};
+  kRandom = 11;
+
+  simulation::Initialize();
+  // Fill the remaining units with obedient ones on open tiles
+  while (kUsedUnit < kMaxUnit) {
+    math::Vec2i tile = RandomTile();
+    if (tilemap::TileTypeSafe(tile) != tilemap::kTileOpen) continue;
+    Unit* unit = UseUnit();
+    unit->transform.position = tilemap::TilePosToWorld(tile);
+    unit->transform.scale = math::Vec3f(0.25f, 0.25f, 0.f);
+    unit->kind = 0;
+  }
+}
+
+// Orders moves and edits the map along the way, returns ticks with a unit
+// on the move
+int
+Run(bool parallel, uint64_t* hash)
+{
+  Reset();
+  simulation::kParallelUpdate = parallel;
+  // A job per unit, so that the few test units still spread over workers
+  simulation::kMoveGrain = 1;
+  int moving = 0;
+  for (int t = 0; t < kTicks; ++t) {
+    if (t % 20 == 0) {
+      math::Vec2f destination = tilemap::TilePosToWorld(RandomTile());
+      PushCommand(Command{Command::kMove, destination});
+    }
+    if (t % 250 == 0) {
+      tilemap::SetTileType(RandomTile(), Random() % 2 ? tilemap::kTileBlock
+                                                      : tilemap::kTileOpen);
+    }
+
+    simulation::Update();
+    hash[t] = simulation::kIntegrityHash;
+
+    for (uint64_t i = 0; i < kUsedUnit; ++i) {
+      if (kUnit[i].command.type == Command::kMove) {
+        moving += 1;
+        break;
+      }
+    }
+  }
+  return moving;
+}
+
+// Changes outside Update are seen, including map edits through the cached
+// tilemap hash
+void
+Integrity()
+{
+  Reset();
+  simulation::Update();
+  ASSERT_TRUE(simulation::VerifyIntegrity());
+  ASSERT_TRUE(simulation::VerifyIntegrity());
+
+  kUnit[0].think_flags ^= 1;
+  ASSERT_TRUE(!simulation::VerifyIntegrity());
+  kUnit[0].think_flags ^= 1;
+  ASSERT_TRUE(simulation::VerifyIntegrity());
+
+  math::Vec2i tile = RandomTile();
+  tilemap::TileType type = tilemap::TileTypeSafe(tile);
+  tilemap::SetTileType(tile, type == tilemap::kTileBlock ? tilemap::kTileOpen
+                                                         : tilemap::kTileBlock);
+  ASSERT_TRUE(!simulation::VerifyIntegrity());
+  simulation::Update();
+  ASSERT_TRUE(simulation::VerifyIntegrity());
+}
+
+int
+main()
+{
+  Integrity();
+
+  int moving = Run(false, kSerialHash);
+  ASSERT_TRUE(moving > kTicks / 2);
+
+  ASSERT_TRUE(JobInitialize(kWorkers));
+  static uint64_t parallel[kTicks];
+  ASSERT_TRUE(Run(true, parallel) == moving);
+  for (int t = 0; t < kTicks; ++t) {
+    if (parallel[t] != kSerialHash[t]) {
+      printf("tick %d serial %016lx parallel %016lx\n", t, kSerialHash[t],
+             parallel[t]);
+      ASSERT_TRUE(!"parallel update diverged");
+    }
+  }
+  JobShutdown();
+
+  printf("%d ticks, %d with units moving, %d workers match serial\n", kTicks,
+         moving, kWorkers);
+  return 0;
+}
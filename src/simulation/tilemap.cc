@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstdio>
+#include <cstring>
 
 #include "math/vec.h"
+#include "platform/x64_intrin.h"
 
 namespace tilemap
 {
@@ -19,15 +21,21 @@ enum TileType {
   kTileEngine = 2,
   kTilePower = 3,
   kTileMine = 4,
+  kTileTypeCount,
 };
 
-struct Tile {
-  math::Vec2i pos;
-  TileType type;
-};
+// Rows and columns of kTileBlock around the map. Neighbors of any tile in
+// [-1, kMapWidth] x [-1, kMapHeight] are read without bounds checks.
+constexpr int kBorder = 2;
+constexpr int kPaddedWidth = kMapWidth + 2 * kBorder;
+constexpr int kPaddedHeight = kMapHeight + 2 * kBorder;
+static_assert(kPaddedWidth <= 64, "A bitboard row is one uint64_t");
 
 struct Tilemap {
-  Tile map[kMapHeight][kMapWidth];
+  // One byte per tile, indexed [y + kBorder][x + kBorder]
+  uint8_t type[kPaddedHeight][kPaddedWidth];
+  // Bit x + kBorder of row y + kBorder is set for tiles of each type
+  uint64_t occupancy[kTileTypeCount][kPaddedHeight];
 };
 
 constexpr int kMaxNeighbor = 8;
@@ -38,6 +46,19 @@ static const math::Vec2i kNeighbor[kMaxNeighbor] = {
 };
 
 static Tilemap kTilemap;
+// Bumped on every change to kTilemap, derived data compares against it
+static uint64_t kTilemapVersion;
+
+// Tiles of each type, maintained with every change to kTilemap
+struct TileIndex {
+  // Unordered y * kMapWidth + x of each tile of a type
+  uint16_t tile[kTileTypeCount][kMapHeight * kMapWidth];
+  uint16_t count[kTileTypeCount];
+  // Position of each tile within the list of its type
+  uint16_t slot[kMapHeight][kMapWidth];
+};
+
+static TileIndex kTileIndex;
 static math::Vec2i kInvalidTile = math::Vec2i{-1, -1};
 
 // clang-format off
@@ -77,25 +98,54 @@ static int kDefaultMap[kMapHeight][kMapWidth] = {
 };
 // clang-format on
 
+void
+TileIndexInsert(const math::Vec2i& pos, TileType type)
+{
+  uint16_t slot = kTileIndex.count[type]++;
+  kTileIndex.tile[type][slot] = pos.y * kMapWidth + pos.x;
+  kTileIndex.slot[pos.y][pos.x] = slot;
+}
+
+void
+TileIndexRemove(const math::Vec2i& pos, TileType type)
+{
+  uint16_t slot = kTileIndex.slot[pos.y][pos.x];
+  uint16_t last = --kTileIndex.count[type];
+  uint16_t moved = kTileIndex.tile[type][last];
+  kTileIndex.tile[type][slot] = moved;
+  kTileIndex.slot[moved / kMapWidth][moved % kMapWidth] = slot;
+}
+
+// Writes the type of a padded tile without touching the index
+void
+TilemapWrite(int px, int py, TileType type)
+{
+  uint64_t bit = 1ull << px;
+  for (int t = 0; t < kTileTypeCount; ++t) {
+    kTilemap.occupancy[t][py] &= ~bit;
+  }
+  kTilemap.occupancy[type][py] |= bit;
+  kTilemap.type[py][px] = type;
+}
+
 void
 Initialize()
 {
+  memset(&kTilemap, 0, sizeof(kTilemap));
+  memset(kTileIndex.count, 0, sizeof(kTileIndex.count));
+  for (int py = 0; py < kPaddedHeight; ++py) {
+    for (int px = 0; px < kPaddedWidth; ++px) {
+      TilemapWrite(px, py, kTileBlock);
+    }
+  }
   for (int i = 0; i < kMapHeight; ++i) {
     for (int j = 0; j < kMapWidth; ++j) {
-      Tile* tile = &kTilemap.map[i][j];
-      tile->type = (TileType)kDefaultMap[i][j];
-      tile->pos.x = j;
-      tile->pos.y = i;
+      TileType type = (TileType)kDefaultMap[i][j];
+      TilemapWrite(j + kBorder, i + kBorder, type);
+      TileIndexInsert(math::Vec2i(j, i), type);
     }
   }
-}
-
-// Returns the center position of the tile.
-math::Vec2f
-TileToWorld(const Tile& tile)
-{
-  return {(tile.pos.x * kTileWidth) + kTileWidth / 2.f,
-          (tile.pos.y * kTileHeight) + kTileHeight / 2.f};
+  kTilemapVersion += 1;
 }
 
 // Returns the center position of the tile.
@@ -125,12 +175,46 @@ TileOk(math::Vec2i pos)
   return true;
 }
 
+void
+SetTileType(const math::Vec2i& pos, TileType type)
+{
+  if (!TileOk(pos)) return;
+  TileType previous = (TileType)kTilemap.type[pos.y + kBorder][pos.x + kBorder];
+  if (previous == type) return;
+  TileIndexRemove(pos, previous);
+  TilemapWrite(pos.x + kBorder, pos.y + kBorder, type);
+  TileIndexInsert(pos, type);
+  kTilemapVersion += 1;
+}
+
 // Returns kTileBlock for non-existent tiles, and TileType otherwise.
 TileType
 TileTypeSafe(const math::Vec2i& pos)
 {
   if (!TileOk(pos)) return kTileBlock;
-  return kTilemap.map[pos.y][pos.x].type;
+  return (TileType)kTilemap.type[pos.y + kBorder][pos.x + kBorder];
+}
+
+// Bit i is set when pos + kNeighbor[i] is kTileOpen.
+// Three row loads and fixed shifts, no per neighbor branches.
+uint64_t
+OpenNeighborMask(const math::Vec2i& pos)
+{
+  // Tiles further out have no neighbor on the map
+  if ((unsigned)(pos.x + 1) > kMapWidth + 1) return 0;
+  if ((unsigned)(pos.y + 1) > kMapHeight + 1) return 0;
+
+  // Bits dx = -1, 0, 1 of the rows above, at and below pos
+  const uint64_t* open = &kTilemap.occupancy[kTileOpen][pos.y + kBorder];
+  int shift = pos.x + kBorder - 1;
+  uint64_t up = (open[-1] >> shift) & 7;
+  uint64_t mid = (open[0] >> shift) & 7;
+  uint64_t down = (open[1] >> shift) & 7;
+
+  // Scatter into kNeighbor order
+  return (mid & 1) | ((mid >> 2) << 1) | (((down >> 1) & 1) << 2) |
+         (((up >> 1) & 1) << 3) | ((down >> 2) << 4) | ((down & 1) << 5) |
+         ((up >> 2) << 6) | ((up & 1) << 7);
 }
 
 // Returns any neighbor of type kTileOpen
@@ -139,45 +223,64 @@ TileOpenAdjacent(const math::Vec2i pos)
 {
   if (TileTypeSafe(pos) == kTileOpen) return pos;
 
-  for (int i = 0; i < kMaxNeighbor; ++i) {
-    math::Vec2i neighbor = pos + kNeighbor[i];
-    if (TileTypeSafe(neighbor) == kTileOpen) return neighbor;
-  }
-
-  return kInvalidTile;
+  uint64_t open = OpenNeighborMask(pos);
+  if (!open) return kInvalidTile;
+  return pos + kNeighbor[TZCNT(open)];
 }
 
+// kNeighbor members by component sign
+constexpr uint64_t kNeighborLeft = (1 << 0) | (1 << 5) | (1 << 7);
+constexpr uint64_t kNeighborRight = (1 << 1) | (1 << 4) | (1 << 6);
+constexpr uint64_t kNeighborDown = (1 << 3) | (1 << 6) | (1 << 7);
+constexpr uint64_t kNeighborUp = (1 << 2) | (1 << 4) | (1 << 5);
+
+// Sum of directions away from every non-open neighbor
 math::Vec3f
 TileAvoidWalls(const math::Vec2i pos)
 {
-  math::Vec2i avoidance = {};
-  for (int i = 0; i < tilemap::kMaxNeighbor; ++i) {
-    math::Vec2i neighbor = pos + tilemap::kNeighbor[i];
-    if (TileTypeSafe(neighbor) != kTileOpen) {
-      math::Vec2i away = (pos - neighbor);
-      avoidance += away;
-    }
-  }
+  uint64_t blocked = ~OpenNeighborMask(pos) & 0xff;
+  int x = (int)POPCNT(blocked & kNeighborLeft) -
+          (int)POPCNT(blocked & kNeighborRight);
+  int y = (int)POPCNT(blocked & kNeighborDown) -
+          (int)POPCNT(blocked & kNeighborUp);
 
-  return math::Vec3f(avoidance.x, avoidance.y, 0.0f);
+  return math::Vec3f(x, y, 0.0f);
 }
 
+// Returns the tile of type closest to from, ties to the lowest row major tile
 bool
-WorldPositionOfTile(TileType type, math::Vec2f* world)
+NearestTileOfType(TileType type, const math::Vec2i& from, math::Vec2i* pos)
 {
-  for (int i = 0; i < kMapHeight; ++i) {
-    for (int j = 0; j < kMapWidth; ++j) {
-      Tile* tile = &kTilemap.map[i][j];
-      tile->type = (TileType)kDefaultMap[i][j];
-      if (tile->type == type) {
-        math::Vec2i near_engine = TileOpenAdjacent(tile->pos);
-        *world = TilePosToWorld(near_engine);
-        return true;
-      }
+  const uint16_t* tile = kTileIndex.tile[type];
+  uint16_t count = kTileIndex.count[type];
+  if (!count) return false;
+
+  int best_distance = INT32_MAX;
+  uint16_t best = 0;
+  for (uint16_t i = 0; i < count; ++i) {
+    int dx = tile[i] % kMapWidth - from.x;
+    int dy = tile[i] / kMapWidth - from.y;
+    int distance = dx * dx + dy * dy;
+    if (distance < best_distance ||
+        (distance == best_distance && tile[i] < best)) {
+      best_distance = distance;
+      best = tile[i];
     }
   }
 
-  return false;
+  *pos = math::Vec2i(best % kMapWidth, best / kMapWidth);
+  return true;
+}
+
+// World position of an open tile next to the nearest tile of type
+bool
+WorldPositionOfTile(TileType type, const math::Vec2f& from,
+                    math::Vec2f* world)
+{
+  math::Vec2i pos;
+  if (!NearestTileOfType(type, WorldToTilePos(from), &pos)) return false;
+  *world = TilePosToWorld(TileOpenAdjacent(pos));
+  return true;
 }
 
 }  // namespace tilemap
@@ -0,0 +1,103 @@
+#include <cassert>
+#include <cstdio>
+
+#include "tilemap.cc"
+
+#define ASSERT_TRUE(x) assert(x)
+
+using namespace tilemap;
+
+// Brute force reference over the whole map
+int
+CountOfType(TileType type)
+{
+  int count = 0;
+  for (int i = 0; i < kMapHeight; ++i) {
+    for (int j = 0; j < kMapWidth; ++j) {
+      count += TileTypeSafe(math::Vec2i(j, i)) == type;
+    }
+  }
+  return count;
+}
+
+void
+IndexMatchesMap()
+{
+  for (int t = 0; t < kTileTypeCount; ++t) {
+    ASSERT_TRUE(kTileIndex.count[t] == CountOfType((TileType)t));
+    for (int i = 0; i < kTileIndex.count[t]; ++i) {
+      uint16_t tile = kTileIndex.tile[t][i];
+      math::Vec2i pos(tile % kMapWidth, tile / kMapWidth);
+      ASSERT_TRUE(TileTypeSafe(pos) == t);
+      ASSERT_TRUE(kTileIndex.slot[pos.y][pos.x] == i);
+    }
+  }
+}
+
+// Reference neighbor kernels, one bounds checked load per neighbor
+uint64_t
+ReferenceOpenMask(math::Vec2i pos)
+{
+  uint64_t mask = 0;
+  for (int i = 0; i < kMaxNeighbor; ++i) {
+    if (TileTypeSafe(pos + kNeighbor[i]) == kTileOpen) mask |= 1 << i;
+  }
+  return mask;
+}
+
+void
+NeighborKernels()
+{
+  for (int y = -3; y < kMapHeight + 3; ++y) {
+    for (int x = -3; x < kMapWidth + 3; ++x) {
+      math::Vec2i pos(x, y);
+      ASSERT_TRUE(OpenNeighborMask(pos) == ReferenceOpenMask(pos));
+
+      math::Vec2i avoidance = {};
+      for (int i = 0; i < kMaxNeighbor; ++i) {
+        if (TileTypeSafe(pos + kNeighbor[i]) != kTileOpen) {
+          avoidance -= kNeighbor[i];
+        }
+      }
+      math::Vec3f fast = TileAvoidWalls(pos);
+      ASSERT_TRUE(fast.x == avoidance.x && fast.y == avoidance.y);
+    }
+  }
+}
+
+int
+main()
+{
+  Initialize();
+  IndexMatchesMap();
+  NeighborKernels();
+
+  // The two mines are at (21, 8) and (21, 22)
+  math::Vec2i pos;
+  ASSERT_TRUE(NearestTileOfType(kTileMine, math::Vec2i(0, 0), &pos));
+  ASSERT_TRUE(pos == math::Vec2i(21, 8));
+  ASSERT_TRUE(NearestTileOfType(kTileMine, math::Vec2i(20, 30), &pos));
+  ASSERT_TRUE(pos == math::Vec2i(21, 22));
+
+  // Queries leave the map untouched
+  uint64_t version = kTilemapVersion;
+  math::Vec2f world;
+  ASSERT_TRUE(WorldPositionOfTile(kTilePower, math::Vec2f(0.f, 0.f), &world));
+  ASSERT_TRUE(kTilemapVersion == version);
+
+  // Changes keep the index current
+  SetTileType(math::Vec2i(21, 8), kTileOpen);
+  SetTileType(math::Vec2i(1, 1), kTileMine);
+  IndexMatchesMap();
+  ASSERT_TRUE(NearestTileOfType(kTileMine, math::Vec2i(20, 8), &pos));
+  ASSERT_TRUE(pos == math::Vec2i(21, 22));
+  ASSERT_TRUE(NearestTileOfType(kTileMine, math::Vec2i(0, 0), &pos));
+  ASSERT_TRUE(pos == math::Vec2i(1, 1));
+  SetTileType(math::Vec2i(1, 1), kTileOpen);
+  SetTileType(math::Vec2i(21, 22), kTileOpen);
+  IndexMatchesMap();
+  ASSERT_TRUE(!NearestTileOfType(kTileMine, math::Vec2i(0, 0), &pos));
+
+  printf("tilemap ok\n");
+  return 0;
+}
@@ -19,13 +19,21 @@ struct State {
   uint64_t frame_time_usec = 0;
   // Allow yielding idle cycles to kernel
   bool sleep_on_loop = true;
+  // Sleeps and spins out the end of each frame
+  Pacer pacer;
   // Number of times the game has been updated.
   uint64_t game_updates = 0;
   uint64_t logic_updates = 0;
   // Number of times the game frame was exceptionally delayed
   uint64_t game_jerk = 0;
+  // Threads sharing the simulation, including the main thread
+  uint64_t worker_count = 1;
+  // Chrome trace of the profile written on exit, when set
+  const char* trace_path = nullptr;
   // TODO (AN): Find a home in simulation/
   Camera player_camera[MAX_PLAYER];
+  // Window input drained while no input frame is captured
+  InputBuffer pending_input;
 };
 
 static State kGameState;
@@ -40,7 +48,7 @@ GetLocalCamera()
 void
 ProcessWindowInput(InputBuffer* input_buffer)
 {
-  uint64_t event_count = 0;
+  uint64_t event_count = input_buffer->used_input_event;
   while (event_count < MAX_TICK_EVENTS) {
     PlatformEvent pevent;
     if (!window::PollEvent(&pevent)) break;
@@ -63,12 +71,24 @@ ProcessWindowInput(InputBuffer* input_buffer)
 void
 ProcessInput()
 {
-  InputBuffer* buffer = GetNextInputBuffer();
+  // Window events are drained every loop, only capturing the input frame
+  // is held back. Pending input goes out with the next captured frame, and
+  // a full pending buffer leaves the rest in the platform queue.
 #ifndef HEADLESS
-  ProcessWindowInput(buffer);
-#else
-  buffer->used_input_event = 0;
+  ProcessWindowInput(&kGameState.pending_input);
 #endif
+  uint64_t count = InputFrameCount(kGameState.logic_updates);
+  for (uint64_t i = 0; i < count; ++i) {
+    InputBuffer* buffer = GetNextInputBuffer();
+    buffer->used_input_event = 0;
+    if (i == 0) {
+      InputBuffer* pending = &kGameState.pending_input;
+      memcpy(buffer->input_event, pending->input_event,
+             pending->used_input_event * sizeof(PlatformEvent));
+      buffer->used_input_event = pending->used_input_event;
+      pending->used_input_event = 0;
+    }
+  }
 }
 
 void
@@ -167,7 +187,7 @@ int
 main(int argc, char** argv)
 {
   while (1) {
-    int opt = platform_getopt(argc, argv, "i:p:n:");
+    int opt = platform_getopt(argc, argv, "i:p:n:j:t:");
     if (opt == -1) break;
 
     switch (opt) {
@@ -180,11 +200,21 @@ main(int argc, char** argv)
       case 'n':
         kNetworkState.num_players = strtol(platform_optarg, NULL, 10);
         break;
+      case 'j':
+        kGameState.worker_count = strtol(platform_optarg, NULL, 10);
+        break;
+      case 't':
+        kGameState.trace_path = platform_optarg;
+        break;
     }
   }
   printf("Client will connect to game at %s:%s\n", kNetworkState.server_ip,
          kNetworkState.server_port);
 
+  if (!ArenaReserve(&kFrameArena, FRAME_ARENA_BYTES)) {
+    return 1;
+  }
+
 #ifndef HEADLESS
   // Platform & Gfx init
   if (!gfx::Initialize()) {
@@ -205,6 +235,17 @@ main(int argc, char** argv)
   if (!simulation::Initialize()) {
     return 1;
   }
+  if (kGameState.worker_count > 1 && !simulation::ParallelUpdateUseful()) {
+    printf("-j %lu ignored: %lu units never fill a %lu unit move job\n",
+           kGameState.worker_count, kMaxUnit, simulation::kMoveGrain);
+    kGameState.worker_count = 1;
+  }
+  if (kGameState.worker_count > 1) {
+    if (!JobInitialize(kGameState.worker_count)) {
+      return 1;
+    }
+    simulation::kParallelUpdate = true;
+  }
 
   // Network handshake uses a clock
   if (!NetworkSetup()) {
@@ -224,10 +265,20 @@ main(int argc, char** argv)
 #endif
   // Reset the clock for simulation
   platform::clock_init(kGameState.frame_target_usec, &kGameState.game_clock);
+  platform::pacer_init(kGameState.sleep_on_loop, &kGameState.pacer);
   while (!window::ShouldClose()) {
-    ProcessInput();
-    NetworkEgress();
-    NetworkIngress(kGameState.logic_updates);
+    ArenaReset(&kFrameArena);
+    ProfileFrame();
+    PROFILE_SCOPE("frame");
+    {
+      PROFILE_SCOPE("input");
+      ProcessInput();
+    }
+    {
+      PROFILE_SCOPE("netcode");
+      NetworkEgress();
+      NetworkIngress(kGameState.logic_updates, kGameState.frame_target_usec);
+    }
 
     uint64_t slot = NETQUEUE_SLOT(kGameState.logic_updates);
     if (SlotReady(slot)) {
@@ -238,6 +289,12 @@ main(int argc, char** argv)
       InputBuffer* game_turn = GetSlot(slot);
       for (int i = 0; i < MAX_PLAYER; ++i) {
         InputBuffer* player_turn = &game_turn[i];
+        // Lockstep peers must agree on the simulation state
+        if (!NetworkHashMatch(player_turn->state_hash)) {
+          printf("Desync with player %d at frame %lu\n", i,
+                 player_turn->state_hash.frame);
+          exit(5);
+        }
         ProcessSimulation(i, player_turn->used_input_event,
                           player_turn->input_event);
       }
@@ -254,19 +311,31 @@ main(int argc, char** argv)
       // Give the user an update tick. The engine runs with
       // a fixed delta so no need to provide a delta time.
       ++kGameState.logic_updates;
+      NetworkStateHash(kGameState.logic_updates, simulation::kIntegrityHash);
     }
 
     // Misc debug/feedback
     gfx::Reset();
     auto sz = window::GetWindowSize();
-    char buffer[50];
+    char buffer[64];
     sprintf(buffer, "Frame Time:%06lu us", kGameState.frame_time_usec);
     gfx::PushText(buffer, 3.f, sz.y);
+    sprintf(buffer, "Net RTT:%06lu us Jitter:%06lu us Delay:%lu",
+            kNetworkState.srtt_usec, kNetworkState.rttvar_usec,
+            kNetworkState.input_delay);
+    gfx::PushText(buffer, 3.f, sz.y - 100.f);
+    sprintf(buffer, "Pace p50:%04lu us p99:%04lu us Margin:%04lu us",
+            platform::pacer_percentile(kGameState.pacer.deviation, .5),
+            platform::pacer_percentile(kGameState.pacer.deviation, .99),
+            kGameState.pacer.margin_usec);
+    gfx::PushText(buffer, 3.f, sz.y - 125.f);
     sprintf(buffer, "Window Size:%ix%i", (int)sz.x, (int)sz.y);
     gfx::PushText(buffer, 3.f, sz.y - 25.f);
     auto mouse = CoordToWorld(window::GetCursorPosition());
     sprintf(buffer, "Mouse Pos In World:(%.1f,%.1f)", mouse.x, mouse.y);
     gfx::PushText(buffer, 3.f, sz.y - 50.f);
+    gfx::PushProfile(&kGameState.game_clock, kProfile.frame - 1, 3.f,
+                     sz.y - 150.f);
 
     for (int i = 0; i < kUsedAsteroid; ++i) {
       math::AxisAlignedRect aabb = gfx::kGfx.asteroid_aabb;
@@ -277,21 +346,26 @@ main(int argc, char** argv)
       }
     }
 
-#ifndef HEADLESS
     // The bottom left and top right of the screen with regards to the camera.
     const Camera* cam = GetLocalCamera();
     const math::Vec2f dims = window::GetWindowSize();
     math::Vec3f top_right = CoordToWorld(dims);
     math::Vec3f bottom_left = CoordToWorld({0.f, 0.f});
-    gfx::Render(math::Rectf{bottom_left.xy(), top_right.xy()});
-#endif
+    {
+      // Headless prepares the frame for the null backend
+      PROFILE_SCOPE("render");
+      gfx::Render(math::Rectf{bottom_left.xy(), top_right.xy()});
+    }
 
     // Capture frame time before the potential stall on vertical sync
     kGameState.frame_time_usec = platform::delta_usec(&kGameState.game_clock);
 
 #ifndef HEADLESS
-    window::SwapBuffers();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+      PROFILE_SCOPE("swap");
+      window::SwapBuffers();
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
 #endif
 
 #if 0
@@ -299,14 +373,13 @@ main(int argc, char** argv)
 #endif
     ++kGameState.game_updates;
 
-    uint64_t sleep_usec = 0;
-    uint64_t sleep_count = kGameState.sleep_on_loop;
-    while (!platform::clock_sync(&kGameState.game_clock, &sleep_usec)) {
-      while (sleep_count) {
-        --sleep_count;
-        platform::sleep_usec(sleep_usec);
-      };
-    }
+    PROFILE_SCOPE("sleep");
+    platform::pacer_wait(&kGameState.pacer, &kGameState.game_clock);
+  }
+
+  platform::pacer_print(&kGameState.pacer);
+  if (kGameState.trace_path) {
+    ProfileWriteChromeTrace(kGameState.trace_path, &kGameState.game_clock);
   }
 
   return 0;
@@ -8,10 +8,10 @@ main(int argc, char** argv)
 {
   const char* ip = "0.0.0.0";
   const char* port = "9845";
-  const char* num_players = "1";
+  uint64_t shard_count = 1;
 
   while (1) {
-    int opt = platform_getopt(argc, argv, "i:p:");
+    int opt = platform_getopt(argc, argv, "i:p:s:");
     if (opt == -1) break;
 
     switch (opt) {
@@ -21,15 +21,18 @@ main(int argc, char** argv)
       case 'p':
         port = platform_optarg;
         break;
+      case 's':
+        shard_count = strtol(platform_optarg, NULL, 10);
+        break;
       default:
-        puts("Usage: server_server -i <ip> -p <port>");
+        puts("Usage: server_server -i <ip> -p <port> -s <shards>");
         return 1;
     }
   }
 
   if (!udp::Init()) return 1;
   
-  if (!CreateNetworkServer(ip, port)) return 2;
+  if (!CreateNetworkServer(ip, port, shard_count)) return 2;
 
   uint64_t result = WaitForNetworkServer();
   printf("%lu\n", result);